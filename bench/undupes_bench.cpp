@@ -0,0 +1,252 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include <benchmark/benchmark.h>
+#include <stddef.h> // for size_t
+#include <stdint.h> // for int64_t
+#include <stdlib.h> // for mkdtemp
+
+#include <cerrno>       // for errno
+#include <filesystem>   // for path, temp_directory_path
+#include <fstream>      // for ofstream
+#include <map>          // for map
+#include <memory>       // for make_shared
+#include <random>       // for mt19937_64
+#include <span>         // for span
+#include <string>       // for string
+#include <system_error> // for system_error, generic_category
+#include <tuple>        // for tuple
+#include <vector>       // for vector
+
+#include "bin_compare_files.h" // for compare_files_fdupes
+#include "compare_kernel.h"    // for CompareKernel
+#include "file_table.h"        // for FileTable, IndexGroups
+#include "filter.h"            // for FileVector, TableHashableFilter
+#include "filters_list.h"      // for FiltersList
+#include "io_stats.h"          // for IOStats
+#include "pipeline.h"          // for Pipeline
+
+namespace fs = std::filesystem;
+
+namespace {
+/**
+ * @brief Groups of generated files, kept for the whole run.  The files of a
+ * group have the same size and the same first `shared_prefix` bytes, and
+ * differ from each other after it, unless the prefix covers the whole file.
+ * The files are read through the page cache, so the numbers are for warm
+ * reads.
+ */
+class Fixtures {
+public:
+  Fixtures() {
+    std::string pattern =
+        (fs::temp_directory_path() / "undupes_bench.XXXXXX").string();
+    if (mkdtemp(pattern.data()) == nullptr)
+      throw std::system_error(errno, std::generic_category(),
+                              "Cannot create the fixture directory");
+    dir = pattern;
+  }
+  ~Fixtures() { fs::remove_all(dir); }
+
+  const FileVector &get(size_t file_size, size_t group_size,
+                        size_t shared_prefix) {
+    auto key = std::make_tuple(file_size, group_size, shared_prefix);
+    auto it = groups.find(key);
+    if (it != groups.end())
+      return it->second;
+    fs::path group_dir = dir / std::to_string(groups.size());
+    fs::create_directories(group_dir);
+    std::mt19937_64 random{groups.size()};
+    std::string prefix = random_bytes(random, shared_prefix);
+    FileVector files;
+    for (size_t i = 0; i < group_size; ++i) {
+      fs::path path = group_dir / std::to_string(i);
+      std::ofstream out{path, std::ios::binary};
+      out << prefix;
+      if (file_size > shared_prefix)
+        out << random_bytes(random, file_size - shared_prefix);
+      files.push_back(std::make_shared<File>(path.string()));
+    }
+    return groups.emplace(key, std::move(files)).first->second;
+  }
+
+private:
+  fs::path dir;
+  std::map<std::tuple<size_t, size_t, size_t>, FileVector> groups;
+
+  static std::string random_bytes(std::mt19937_64 &random, size_t size) {
+    std::string bytes(size, '\0');
+    for (char &c : bytes)
+      c = static_cast<char>(random());
+    return bytes;
+  }
+};
+
+Fixtures fixtures;
+
+/**
+ * @brief Fixture files in a FileTable, as one group, the way the scan hands
+ * them to the filters.
+ */
+struct Group {
+  explicit Group(const FileVector &files) {
+    std::vector<FileTable::Index> indices;
+    for (const auto &file : files)
+      indices.push_back(table.add(file->get_path(), *file->get_stat()));
+    groups.add(indices);
+  }
+
+  FileTable table;
+  IndexGroups groups;
+};
+
+// Files/s, and bytes/s for the stages which work on buffers in memory.
+void report(benchmark::State &state, size_t files, size_t bytes_per_file) {
+  state.SetItemsProcessed(state.iterations() * files);
+  if (bytes_per_file > 0)
+    state.SetBytesProcessed(state.iterations() * files * bytes_per_file);
+}
+
+// Files/s, and bytes/s for the stages which read the files, counting the
+// bytes they read since `before` rather than the size of the files, since
+// they stop reading a file as soon as it differs from the others.
+void report_reads(benchmark::State &state, size_t files,
+                  const IOStats::Counters &before) {
+  state.SetItemsProcessed(state.iterations() * files);
+  state.SetBytesProcessed(
+      static_cast<int64_t>((IOStats::snapshot() - before).bytes_read));
+}
+} // namespace
+
+// Arguments: group size, file size.
+void BM_xxhash_heads(benchmark::State &state) {
+  size_t size = state.range(1);
+  const FileVector &files = fixtures.get(size, state.range(0), 0);
+  std::vector<std::string> paths;
+  for (const auto &file : files)
+    paths.push_back(file->get_path());
+  IOStats::Counters before = IOStats::snapshot();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(FiltersList::xxhash_heads(paths));
+  report_reads(state, files.size(), before);
+}
+BENCHMARK(BM_xxhash_heads)
+    ->ArgsProduct({benchmark::CreateRange(8, 4096, 8), {1 << 10, 1 << 20}});
+
+// Arguments: file size, shared prefix in percent of the file.
+void BM_compare_files_fdupes(benchmark::State &state) {
+  size_t size = state.range(0);
+  size_t prefix = size * state.range(1) / 100;
+  const FileVector &files = fixtures.get(size, 2, prefix);
+  IOStats::Counters before = IOStats::snapshot();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(compare_files_fdupes(
+        files.at(0)->get_path(), files.at(1)->get_path()));
+  report_reads(state, 2, before);
+}
+BENCHMARK(BM_compare_files_fdupes)
+    ->ArgsProduct({benchmark::CreateRange(1 << 10, 64 << 20, 64),
+                   {0, 50, 100}});
+
+// Arguments: group size, file size.
+void BM_TableHashableFilter_file_size(benchmark::State &state) {
+  Group group{fixtures.get(state.range(1), state.range(0), 0)};
+  for (auto _ : state) {
+    TableHashableFilter filter{
+        group.table, group.groups,
+        [](const FileTable &t, FileTable::Index i) { return t.file_size(i); }};
+    benchmark::DoNotOptimize(filter.new_groups);
+  }
+  report(state, group.table.size(), 0);
+}
+BENCHMARK(BM_TableHashableFilter_file_size)
+    ->ArgsProduct({benchmark::CreateRange(8, 4096, 8), {1 << 10}});
+
+// Arguments: group size, file size, shared prefix in percent of the file.
+void BM_xxhash_progressive(benchmark::State &state) {
+  size_t size = state.range(1);
+  size_t prefix = size * state.range(2) / 100;
+  Group group{fixtures.get(size, state.range(0), prefix)};
+  IOStats::Counters before = IOStats::snapshot();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        FiltersList::xxhash_progressive(group.table, group.groups[0]));
+  report_reads(state, group.table.size(), before);
+}
+BENCHMARK(BM_xxhash_progressive)
+    ->ArgsProduct({{8, 64, 512},
+                   benchmark::CreateRange(1 << 10, 1 << 20, 32),
+                   {0, 100}});
+
+// Arguments: group size, file size, shared prefix in percent of the file.
+// The whole verification a size group goes through: progressive hashing,
+// then the byte comparison of the files with equal hashes.  With the whole
+// file shared the group is one set of duplicates, the case which reads the
+// most.
+void BM_Pipeline(benchmark::State &state) {
+  size_t size = state.range(1);
+  size_t prefix = size * state.range(2) / 100;
+  Group group{fixtures.get(size, state.range(0), prefix)};
+  IOStats::Counters before = IOStats::snapshot();
+  for (auto _ : state) {
+    size_t sets{0};
+    Pipeline::run(group.table, group.groups, nullptr, true,
+                  [&sets](std::span<const FileTable::Index>) { ++sets; });
+    benchmark::DoNotOptimize(sets);
+  }
+  report_reads(state, group.table.size(), before);
+}
+BENCHMARK(BM_Pipeline)
+    ->ArgsProduct({{2, 8, 32},
+                   benchmark::CreateRange(1 << 10, 1 << 20, 32),
+                   {0, 50, 100}});
+
+// Arguments: kernel, buffer size, candidates compared against the reference.
+// The buffers are equal, so every byte of every candidate is compared.
+void BM_compare_kernel(benchmark::State &state) {
+  auto kind = static_cast<CompareKernel::Kind>(state.range(0));
+  size_t size = state.range(1);
+  size_t count = state.range(2);
+  if (!CompareKernel::supported(kind)) {
+    state.SkipWithError("The CPU does not support the kernel");
+    return;
+  }
+  CompareKernel::Kind previous = CompareKernel::active();
+  CompareKernel::use(kind);
+  state.SetLabel(CompareKernel::name(kind));
+  std::vector<std::vector<unsigned char>> buffers(
+      count + 1, std::vector<unsigned char>(size, 0x5a));
+  std::vector<const unsigned char *> candidates;
+  for (size_t c = 1; c <= count; ++c)
+    candidates.push_back(buffers.at(c).data());
+  std::vector<size_t> offsets(count);
+  for (auto _ : state) {
+    CompareKernel::first_differences(buffers.front().data(), candidates.data(),
+                                     count, size, offsets.data());
+    benchmark::DoNotOptimize(offsets.data());
+  }
+  report(state, count, size);
+  CompareKernel::use(previous);
+}
+BENCHMARK(BM_compare_kernel)
+    ->ArgsProduct({{0, 1, 2, 3},
+                   benchmark::CreateRange(4 << 10, 4 << 20, 32),
+                   {1, 8}});
+
+BENCHMARK_MAIN();
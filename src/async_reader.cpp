@@ -0,0 +1,390 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "async_reader.h"
+
+#include <errno.h>          // for errno, EINTR, EAGAIN, EINVAL
+#include <linux/io_uring.h> // for io_uring_params, io_uring_sqe
+#include <string.h>         // for memset
+#include <sys/mman.h>       // for mmap, munmap
+#include <sys/stat.h>       // for fstat
+#include <sys/syscall.h>    // for __NR_io_uring_setup
+#include <sys/uio.h>        // for iovec
+#include <unistd.h>         // for close, syscall
+
+#include <algorithm> // for min
+#include <stdexcept> // for runtime_error
+
+#include "debug.h"      // for warn, info
+#include "io_stats.h"   // for IOStats
+#include "page_cache.h" // for PageCache
+#include "sparse.h"     // for Sparse
+#include "throttle.h"   // for Throttle
+
+namespace {
+int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/**
+ * @brief Read into buffer until it is full or the file ends.
+ *
+ * @return The number of bytes read or -1 on error.
+ */
+ssize_t pread_full(int fd, unsigned char *buffer, size_t size,
+                   uint64_t offset) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t r =
+        PageCache::pread(fd, buffer + total, size - total, offset + total);
+    if (r >= 0) {
+      IOStats::count_read(static_cast<size_t>(r));
+      Throttle::account(static_cast<size_t>(r));
+    }
+    if (r < 0)
+      return -1;
+    if (r == 0)
+      break;
+    total += static_cast<size_t>(r);
+  }
+  return static_cast<ssize_t>(total);
+}
+} // namespace
+
+/**
+ * @brief Create the best reader available.
+ *
+ * @param queue_depth The number of reads to keep in flight.
+ * @param block_size The size of every read.
+ *
+ * @return An io_uring reader or, if the kernel does not allow one, a pread
+ * reader.
+ */
+std::unique_ptr<AsyncReader> AsyncReader::create(size_t queue_depth,
+                                                 size_t block_size) {
+  if (queue_depth > 1) {
+    std::unique_ptr<AsyncReader> reader =
+        UringReader::create(queue_depth, block_size);
+    if (reader != nullptr)
+      return reader;
+    spdlog::info("io_uring is not available, reading with pread.");
+  }
+  return std::make_unique<PreadReader>(block_size);
+}
+
+PreadReader::PreadReader(size_t _block_size)
+    : block_size{_block_size}, buffer{_block_size} {}
+
+void PreadReader::read_ranges(const std::vector<std::string> &paths,
+                              const std::vector<uint64_t> &offsets,
+                              uint64_t limit, const BlockCallback &on_block,
+                              std::vector<bool> &ok) {
+  ok.assign(paths.size(), false);
+  for (size_t i = 0; i < paths.size(); ++i) {
+    int fd = PageCache::open(paths.at(i).c_str());
+    if (fd < 0) {
+      spdlog::warn("Could not open file, skipping: {}", paths.at(i));
+      continue;
+    }
+    IOStats::count_open();
+    Sparse::Extents extents{fd};
+    uint64_t offset = offsets.at(i);
+    while (true) {
+      uint64_t hole = extents.hole(offset, limit == 0 ? UINT64_MAX : limit);
+      Sparse::feed_zeros(hole, [&](const unsigned char *data, size_t size) {
+        on_block(i, data, size);
+      });
+      offset += hole;
+      size_t size =
+          limit == 0 ? block_size
+          : offset >= limit ? 0
+                            : std::min<uint64_t>(block_size, limit - offset);
+      if (extents.data_end(offset) - offset < size)
+        size = static_cast<size_t>(extents.data_end(offset) - offset);
+      ssize_t r = size == 0 ? 0 : pread_full(fd, buffer.data(), size, offset);
+      if (r < 0) {
+        spdlog::warn("Error reading file, skipping: {}", paths.at(i));
+        break;
+      }
+      if (r > 0)
+        on_block(i, buffer.data(), static_cast<size_t>(r));
+      offset += static_cast<uint64_t>(r);
+      if (static_cast<size_t>(r) < size || size == 0) {
+        ok.at(i) = true;
+        break;
+      }
+    }
+    PageCache::close(fd);
+  }
+}
+
+/**
+ * @brief The mapped submission and completion rings of an io_uring instance.
+ */
+struct UringReader::Ring {
+  int fd{-1};
+  void *sq_ptr{MAP_FAILED}, *cq_ptr{MAP_FAILED};
+  size_t sq_size{0}, cq_size{0};
+  struct io_uring_sqe *sqes{static_cast<struct io_uring_sqe *>(MAP_FAILED)};
+  size_t sqes_size{0};
+  unsigned *sq_head{}, *sq_tail{}, *sq_mask{}, *sq_array{};
+  unsigned *cq_head{}, *cq_tail{}, *cq_mask{};
+  struct io_uring_cqe *cqes{};
+
+  ~Ring() {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqes_size);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED)
+      munmap(sq_ptr, sq_size);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  struct io_uring_sqe *next_sqe() {
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+  }
+
+  unsigned unsubmitted() const {
+    return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  }
+};
+
+/**
+ * @brief Set up an io_uring with queue_depth registered buffers.
+ *
+ * @return The reader, or nullptr if io_uring cannot be used.
+ */
+std::unique_ptr<UringReader> UringReader::create(size_t queue_depth,
+                                                 size_t block_size) {
+  std::unique_ptr<UringReader> reader{new UringReader{}};
+  reader->ring = std::make_unique<Ring>();
+  Ring &ring = *reader->ring;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring.fd = io_uring_setup(static_cast<unsigned>(queue_depth), &params);
+  if (ring.fd < 0)
+    return nullptr;
+
+  ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring.cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    ring.sq_size = ring.cq_size = std::max(ring.sq_size, ring.cq_size);
+  ring.sq_ptr = mmap(nullptr, ring.sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+  if (ring.sq_ptr == MAP_FAILED)
+    return nullptr;
+  ring.cq_ptr = single_mmap ? ring.sq_ptr
+                            : mmap(nullptr, ring.cq_size, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ring.fd,
+                                   IORING_OFF_CQ_RING);
+  if (ring.cq_ptr == MAP_FAILED)
+    return nullptr;
+  ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring.sqes = static_cast<struct io_uring_sqe *>(
+      mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES));
+  if (ring.sqes == MAP_FAILED)
+    return nullptr;
+
+  char *sq = static_cast<char *>(ring.sq_ptr);
+  char *cq = static_cast<char *>(ring.cq_ptr);
+  ring.sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  ring.sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  ring.sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  ring.sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  ring.cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  ring.cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  ring.cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  ring.cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  reader->queue_depth = std::min<size_t>(queue_depth, params.sq_entries);
+  reader->block_size = block_size;
+  reader->buffers =
+      std::make_unique<PageCache::Buffer>(reader->queue_depth * block_size);
+
+  // Registered buffers save the kernel from mapping the pages on every read.
+  // It fails when the buffers exceed RLIMIT_MEMLOCK, plain reads are used then.
+  std::vector<struct iovec> iovecs(reader->queue_depth);
+  for (size_t i = 0; i < iovecs.size(); ++i)
+    iovecs.at(i) = {reader->buffers->data() + i * block_size, block_size};
+  reader->fixed_buffers =
+      io_uring_register(ring.fd, IORING_REGISTER_BUFFERS, iovecs.data(),
+                        static_cast<unsigned>(iovecs.size())) == 0;
+  return reader;
+}
+
+UringReader::~UringReader() { ring.reset(); }
+
+void UringReader::read_ranges(const std::vector<std::string> &paths,
+                              const std::vector<uint64_t> &offsets,
+                              uint64_t limit, const BlockCallback &on_block,
+                              std::vector<bool> &ok) {
+  // A read ends at min(limit, file size) as stat'ed at open, so the last
+  // read of a file does not have to come back empty to tell the end.  When
+  // bypassing the page cache, the last read is rounded up for O_DIRECT.
+  struct Slot {
+    size_t file;
+    int fd{-1};
+    uint64_t offset;
+    uint64_t end;
+    Sparse::Extents extents;
+  };
+  // Closes the files still open when the reads end with an exception.
+  struct OpenFiles {
+    std::vector<Slot> &slots;
+    ~OpenFiles() {
+      for (Slot &slot : slots)
+        if (slot.fd >= 0)
+          PageCache::close(slot.fd);
+    }
+  };
+  ok.assign(paths.size(), false);
+  std::vector<Slot> slots(queue_depth);
+  OpenFiles open_files{slots};
+  std::vector<size_t> free_slots;
+  for (size_t i = queue_depth; i > 0; --i)
+    free_slots.push_back(i - 1);
+  size_t next_file = 0, in_flight = 0;
+
+  auto queue_read = [&](size_t s) {
+    Slot &slot = slots.at(s);
+    size_t size = std::min<uint64_t>(
+        block_size,
+        std::min(slot.end, slot.extents.data_end(slot.offset)) - slot.offset);
+    if (PageCache::bypass())
+      size = std::min(block_size, PageCache::round_up(size));
+    struct io_uring_sqe *sqe = ring->next_sqe();
+    sqe->opcode = fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = slot.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffers->data() + s * block_size);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->off = slot.offset;
+    sqe->buf_index = static_cast<uint16_t>(s);
+    sqe->user_data = s;
+    ++in_flight;
+  };
+  auto finish = [&](size_t s, bool success) {
+    PageCache::close(slots.at(s).fd);
+    slots.at(s).fd = -1;
+    ok.at(slots.at(s).file) = success;
+    free_slots.push_back(s);
+  };
+  // Hand on the hole at the offset of a file as zeros, then queue the read of
+  // the data after it, or finish the file at its end.
+  auto advance = [&](size_t s) {
+    Slot &slot = slots.at(s);
+    uint64_t hole = slot.extents.hole(slot.offset, slot.end);
+    Sparse::feed_zeros(hole, [&](const unsigned char *data, size_t size) {
+      on_block(slot.file, data, size);
+    });
+    slot.offset += hole;
+    if (slot.offset >= slot.end)
+      finish(s, true);
+    else
+      queue_read(s);
+  };
+
+  while (true) {
+    while (!free_slots.empty() && next_file < paths.size()) {
+      int fd = PageCache::open(paths.at(next_file).c_str());
+      if (fd < 0) {
+        spdlog::warn("Could not open file, skipping: {}", paths.at(next_file));
+        ++next_file;
+        continue;
+      }
+      IOStats::count_open();
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        spdlog::warn("Could not stat file, skipping: {}", paths.at(next_file));
+        PageCache::close(fd);
+        ++next_file;
+        continue;
+      }
+      uint64_t end = static_cast<uint64_t>(st.st_size);
+      if (limit != 0)
+        end = std::min(end, limit);
+      size_t s = free_slots.back();
+      free_slots.pop_back();
+      uint64_t offset = offsets.at(next_file);
+      slots.at(s) = Slot{next_file++, fd, offset, end, Sparse::Extents{fd, st}};
+      advance(s);
+    }
+    if (in_flight == 0)
+      break;
+
+    if (io_uring_enter(ring->fd, ring->unsubmitted(), 1,
+                       IORING_ENTER_GETEVENTS) < 0 &&
+        errno != EINTR)
+      throw std::runtime_error("io_uring_enter failed.");
+
+    unsigned head = *ring->cq_head;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      const struct io_uring_cqe &cqe = ring->cqes[head & *ring->cq_mask];
+      size_t s = static_cast<size_t>(cqe.user_data);
+      int res = cqe.res;
+      ++head;
+      __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+      --in_flight;
+
+      Slot &slot = slots.at(s);
+      if (res == -EINTR || res == -EAGAIN ||
+          (res == -EINVAL && PageCache::fall_back(slot.fd))) {
+        queue_read(s);
+      } else if (res < 0) {
+        spdlog::warn("Error reading file, skipping: {}", paths.at(slot.file));
+        finish(s, false);
+      } else if (res == 0) {
+        IOStats::count_read(0);
+        Throttle::account(0);
+        finish(s, true);
+      } else {
+        IOStats::count_read(static_cast<size_t>(res));
+        Throttle::account(static_cast<size_t>(res));
+        // A rounded up read may run past the limit.
+        size_t size = std::min<uint64_t>(static_cast<uint64_t>(res),
+                                         slot.end - slot.offset);
+        on_block(slot.file, buffers->data() + s * block_size, size);
+        slot.offset += size;
+        advance(s);
+      }
+    }
+  }
+}
@@ -0,0 +1,120 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <functional> // for function
+#include <memory>     // for unique_ptr
+#include <string>     // for string
+#include <vector>     // for vector
+
+#include "page_cache.h" // for PageCache
+
+/**
+ * @brief Reads many files with several reads in flight.  Each file is read
+ * from the start, or from an offset of its own, up to a limit, and its data is
+ * handed to a callback in file order, one block at a time.
+ *
+ * create() returns an io_uring backed reader with a ring of registered
+ * buffers, or a pread() based one when io_uring is not available.
+ */
+class AsyncReader {
+public:
+  // Called with the index of the file and the next block of its data.
+  using BlockCallback =
+      std::function<void(size_t index, const unsigned char *data, size_t size)>;
+
+  virtual ~AsyncReader() = default;
+
+  /**
+   * @brief Read the files.
+   *
+   * @param paths The files to read.
+   * @param limit The number of bytes to read from every file, 0 for all.
+   * @param on_block The callback for the data read.
+   * @param ok Set to whether each file was read without errors.
+   */
+  void read_files(const std::vector<std::string> &paths, uint64_t limit,
+                  const BlockCallback &on_block, std::vector<bool> &ok) {
+    read_ranges(paths, std::vector<uint64_t>(paths.size(), 0), limit, on_block,
+                ok);
+  }
+
+  /**
+   * @brief Read the files from the given offsets on.
+   *
+   * @param paths The files to read.
+   * @param offsets The offset to start reading each file at.
+   * @param limit The offset to stop reading at, 0 for the end of the file.
+   * @param on_block The callback for the data read.
+   * @param ok Set to whether each file was read without errors.
+   */
+  virtual void read_ranges(const std::vector<std::string> &paths,
+                           const std::vector<uint64_t> &offsets, uint64_t limit,
+                           const BlockCallback &on_block,
+                           std::vector<bool> &ok) = 0;
+  virtual const char *name() const = 0;
+
+  static std::unique_ptr<AsyncReader> create(size_t queue_depth,
+                                             size_t block_size);
+};
+
+/**
+ * @brief The fallback reader, one blocking pread() at a time.
+ */
+class PreadReader : public AsyncReader {
+public:
+  explicit PreadReader(size_t _block_size);
+  void read_ranges(const std::vector<std::string> &paths,
+                   const std::vector<uint64_t> &offsets, uint64_t limit,
+                   const BlockCallback &on_block,
+                   std::vector<bool> &ok) override;
+  const char *name() const override { return "pread"; }
+
+private:
+  size_t block_size;
+  PageCache::Buffer buffer;
+};
+
+/**
+ * @brief An io_uring reader.  Keeps up to queue_depth reads in flight, at most
+ * one per file, so the data of a file always arrives in order.
+ */
+class UringReader : public AsyncReader {
+public:
+  static std::unique_ptr<UringReader> create(size_t queue_depth,
+                                             size_t block_size);
+  ~UringReader() override;
+  void read_ranges(const std::vector<std::string> &paths,
+                   const std::vector<uint64_t> &offsets, uint64_t limit,
+                   const BlockCallback &on_block,
+                   std::vector<bool> &ok) override;
+  const char *name() const override { return "io_uring"; }
+
+private:
+  UringReader() = default;
+  struct Ring;
+  std::unique_ptr<Ring> ring;
+  size_t queue_depth{0};
+  size_t block_size{0};
+  std::unique_ptr<PageCache::Buffer> buffers;
+  bool fixed_buffers{false};
+};
@@ -18,48 +18,342 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // SPDX-License-Identifier: AGPL-3.0
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
 
-#include <stdio.h>  // for fclose, fopen, fread, fseek, FILE, SEEK_SET
-#include <string.h> // for memcmp
+#include "bin_compare_files.h"
 
-#include <string> // for basic_string, string
+#include <errno.h>  // for errno, EMFILE, ENFILE
+#include <string.h> // for memset
+
+#include <algorithm> // for clamp, min, sort
+#include <numeric>   // for iota
+#include <string>    // for basic_string, string
+#include <vector>    // for vector
+
+#include "compare_kernel.h" // for CompareKernel
+#include "debug.h"          // for warn
+#include "io_stats.h"       // for IOStats
+#include "page_cache.h"     // for PageCache
+#include "sparse.h"         // for Sparse
+#include "throttle.h"       // for Throttle
 #define CHUNK_SIZE 65536
+// The most memory compare_files_lockstep uses for its buffers.
+#define LOCKSTEP_BUFFER_BYTES (64 << 20)
+namespace {
 /**
- * @brief Binary compare two files. TODO: Handle singint.
+ * @brief Read up to chunk_size bytes from an offset on, retrying short reads.
+ * The holes of a sparse file are filled with zeros instead of being read.
+ *
+ * @return The number of bytes read, less than chunk_size only at the end of
+ * the file, or -1 on error.
+ */
+ssize_t read_chunk(int fd, Sparse::Extents &extents, uint64_t offset,
+                   unsigned char *buffer, size_t chunk_size) {
+  size_t total = 0;
+  while (total < chunk_size) {
+    uint64_t hole = extents.hole(offset + total, offset + chunk_size);
+    if (hole != 0) {
+      memset(buffer + total, 0, static_cast<size_t>(hole));
+      total += static_cast<size_t>(hole);
+      continue;
+    }
+    size_t size = static_cast<size_t>(std::min<uint64_t>(
+        chunk_size - total, extents.data_end(offset + total) - offset - total));
+    ssize_t r = PageCache::pread(fd, buffer + total, size, offset + total);
+    if (r >= 0) {
+      IOStats::count_read(static_cast<size_t>(r));
+      Throttle::account(static_cast<size_t>(r));
+    }
+    if (r < 0)
+      return -1;
+    if (r == 0)
+      break;
+    total += static_cast<size_t>(r);
+  }
+  return static_cast<ssize_t>(total);
+}
+} // namespace
+
+/**
+ * @brief Binary compare two files. TODO: Handle singint.  The holes the two
+ * files have in the same place are skipped.
  *
  * @param filename_1 Filename of the first file.
  * @param filename_2 Filename of the second file.
  *
- * @return Boolean whether the files are equal or not.
+ * @return Boolean whether the files are equal or not, false if either cannot
+ * be read.
  */
 // Taken from fdupes/confirmmatch.c
 bool compare_files_fdupes(const std::string &filename_1,
                           const std::string &filename_2) {
-  FILE *file1 = fopen(filename_1.c_str(), "rb");
-  FILE *file2 = fopen(filename_2.c_str(), "rb");
-  unsigned char c1[CHUNK_SIZE];
-  unsigned char c2[CHUNK_SIZE];
-
-  fseek(file1, 0, SEEK_SET);
-  fseek(file2, 0, SEEK_SET);
-  size_t r2;
-  do {
-    size_t r1;
-    r1 = fread(c1, sizeof(unsigned char), sizeof(c1), file1);
-    r2 = fread(c2, sizeof(unsigned char), sizeof(c2), file2);
-
-    if (r1 != r2) {
-      fclose(file1);
-      fclose(file2);
-      return 0; /* file lengths are different */
+  int fd1 = PageCache::open(filename_1.c_str());
+  int fd2 = PageCache::open(filename_2.c_str());
+  if (fd1 < 0 || fd2 < 0) {
+    if (fd1 >= 0)
+      PageCache::close(fd1);
+    if (fd2 >= 0)
+      PageCache::close(fd2);
+    return false;
+  }
+  IOStats::count_open();
+  IOStats::count_open();
+  Sparse::Extents extents1{fd1}, extents2{fd2};
+  PageCache::Buffer c1{CHUNK_SIZE};
+  PageCache::Buffer c2{CHUNK_SIZE};
+
+  uint64_t offset = 0;
+  bool same = true;
+  while (true) {
+    offset += std::min(extents1.hole(offset, UINT64_MAX),
+                       extents2.hole(offset, UINT64_MAX));
+    ssize_t r1 = read_chunk(fd1, extents1, offset, c1.data(), CHUNK_SIZE);
+    ssize_t r2 = read_chunk(fd2, extents2, offset, c2.data(), CHUNK_SIZE);
+    /* file lengths are different, or contents are different */
+    if (r1 < 0 || r1 != r2 ||
+        CompareKernel::first_difference(c1.data(), c2.data(),
+                                        static_cast<size_t>(r1)) !=
+            static_cast<size_t>(r1)) {
+      same = false;
+      break;
+    }
+    if (r1 == 0)
+      break;
+    offset += static_cast<uint64_t>(r1);
+  }
+
+  PageCache::close(fd1);
+  PageCache::close(fd2);
+  return same;
+}
+
+namespace {
+/**
+ * @brief Split the files into classes by comparing them pairwise with
+ * compare_files_fdupes.  Used when there are too many files to keep open.
+ */
+FileClasses compare_files_pairwise(const std::vector<std::string> &filenames) {
+  FileClasses classes;
+  std::vector<bool> taken(filenames.size(), false);
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    if (taken.at(i))
+      continue;
+    classes.push_back({i});
+    for (size_t j = i + 1; j < filenames.size(); ++j) {
+      if (!taken.at(j) &&
+          compare_files_fdupes(filenames.at(i), filenames.at(j))) {
+        classes.back().push_back(j);
+        taken.at(j) = true;
+      }
+    }
+  }
+  return classes;
+}
+
+/**
+ * @brief The lock-step comparison of compare_files_lockstep_chunked, for a
+ * group small enough to have a chunk of every file in memory at once.
+ */
+FileClasses lockstep(const std::vector<std::string> &filenames,
+                     size_t max_chunk) {
+  const size_t N = filenames.size();
+  std::vector<int> fds(N, -1);
+  auto close_class = [&fds](const std::vector<size_t> &members) {
+    for (const auto &i : members) {
+      if (fds.at(i) >= 0)
+        PageCache::close(fds.at(i));
+      fds.at(i) = -1;
+    }
+  };
+  auto close_all = [&fds]() {
+    for (auto &fd : fds) {
+      if (fd >= 0)
+        PageCache::close(fd);
+      fd = -1;
     }
-    if (memcmp(c1, c2, r1)) {
-      fclose(file1);
-      fclose(file2);
-      return 0; /* file contents are different */
+  };
+
+  std::vector<Sparse::Extents> extents(N);
+  std::vector<uint64_t> offsets(N, 0);
+  std::vector<size_t> opened;
+  for (size_t i = 0; i < N; ++i) {
+    fds.at(i) = PageCache::open(filenames.at(i).c_str());
+    if (fds.at(i) >= 0) {
+      IOStats::count_open();
+      extents.at(i) = Sparse::Extents{fds.at(i)};
+      opened.push_back(i);
+      continue;
+    }
+    if (errno == EMFILE || errno == ENFILE) {
+      close_all();
+      return compare_files_pairwise(filenames);
     }
-  } while (r2);
+    spdlog::warn("Could not open file, skipping: {}", filenames.at(i));
+  }
+
+  // Whole pages, for O_DIRECT.
+  const size_t chunk_size =
+      std::clamp<size_t>(LOCKSTEP_BUFFER_BYTES / std::max<size_t>(N, 1),
+                         PageCache::alignment,
+                         std::max<size_t>(max_chunk, PageCache::alignment)) /
+      PageCache::alignment * PageCache::alignment;
+  PageCache::Buffer buffers{N * chunk_size};
+  std::vector<ssize_t> sizes(N, 0);
+  std::vector<const unsigned char *> candidates;
+  std::vector<size_t> differences;
+  FileClasses active, done;
+  if (!opened.empty())
+    active.push_back(opened);
+
+  while (!active.empty()) {
+    FileClasses next;
+    for (const auto &members : active) {
+      if (members.size() < 2) {
+        close_class(members);
+        done.push_back(members);
+        continue;
+      }
+      // The files of a class are at the same offset, a hole they all have
+      // there is the same in all of them.
+      uint64_t hole = UINT64_MAX;
+      for (const auto &i : members)
+        hole = std::min(hole, extents.at(i).hole(offsets.at(i), UINT64_MAX));
+      for (const auto &i : members) {
+        offsets.at(i) += hole;
+        sizes.at(i) = read_chunk(fds.at(i), extents.at(i), offsets.at(i),
+                                 buffers.data() + i * chunk_size, chunk_size);
+        if (sizes.at(i) < 0)
+          spdlog::warn("Error reading file, skipping: {}", filenames.at(i));
+        else
+          offsets.at(i) += static_cast<uint64_t>(sizes.at(i));
+      }
+
+      // Split by the chunk just read.  The first file left is compared
+      // against all the others of the same size in one pass, and those equal
+      // to it make a split.
+      std::vector<size_t> left;
+      for (const auto &i : members) {
+        if (sizes.at(i) < 0) {
+          close_class({i});
+          done.push_back({i});
+        } else
+          left.push_back(i);
+      }
+      FileClasses split;
+      while (!left.empty()) {
+        const size_t r = left.front();
+        const size_t size = static_cast<size_t>(sizes.at(r));
+        candidates.clear();
+        for (size_t k = 1; k < left.size(); ++k)
+          if (sizes.at(left.at(k)) == sizes.at(r))
+            candidates.push_back(buffers.data() + left.at(k) * chunk_size);
+        differences.resize(candidates.size());
+        CompareKernel::first_differences(buffers.data() + r * chunk_size,
+                                         candidates.data(), candidates.size(),
+                                         size, differences.data());
+        std::vector<size_t> same{r}, rest;
+        for (size_t k = 1, c = 0; k < left.size(); ++k) {
+          if (sizes.at(left.at(k)) == sizes.at(r) &&
+              differences.at(c++) == size)
+            same.push_back(left.at(k));
+          else
+            rest.push_back(left.at(k));
+        }
+        split.push_back(std::move(same));
+        left = std::move(rest);
+      }
+
+      for (auto &c : split) {
+        if (static_cast<size_t>(sizes.at(c.front())) < chunk_size ||
+            c.size() < 2) {
+          close_class(c);
+          done.push_back(std::move(c));
+        } else
+          next.push_back(std::move(c));
+      }
+    }
+    active = std::move(next);
+  }
+  close_all();
+
+  std::sort(done.begin(), done.end());
+  return done;
+}
+} // namespace
+
+/**
+ * @brief Split a group of files into classes of identical content.  Every file
+ * is opened once and all of them are read in lock-step, a chunk at a time.
+ * After every chunk a class is split by the content of the chunk, and classes
+ * that are down to a single file are closed.  So each file is read at most
+ * once, sequentially, however large the group is.  Holes all the files of a
+ * class have at the same offset are skipped.  The chunk is CHUNK_SIZE
+ * bytes unless that would take more than LOCKSTEP_BUFFER_BYTES for the group.
+ * compare_files_lockstep_chunked() takes the chunk size instead.
+ *
+ * Files that cannot be opened or read are logged and left out.  If the process
+ * runs out of file descriptors the group falls back to compare_files_fdupes.
+ *
+ * @param filenames The files to compare, usually all of the same size.
+ *
+ * @return The classes, as indices into filenames.  Each class is in input
+ * order and the classes are ordered by their first file.
+ */
+FileClasses compare_files_lockstep(const std::vector<std::string> &filenames) {
+  return compare_files_lockstep_chunked(filenames, CHUNK_SIZE);
+}
 
-  fclose(file1);
-  fclose(file2);
-  return 1;
+/**
+ * @brief compare_files_lockstep with larger or smaller chunks, such as the
+ * block size of the device the files are on.  A group with more files than
+ * fit a page each in LOCKSTEP_BUFFER_BYTES is compared in rounds instead: the
+ * first file left is compared in lock-step against batches of the others, its
+ * class is done, and the files which differ from it go on to the next round.
+ * The groups come from the hash stage, so it is almost always one round.
+ *
+ * @param filenames The files to compare.
+ * @param max_chunk The size of a chunk, before it is cut down to fit the
+ * group in LOCKSTEP_BUFFER_BYTES.
+ * @param max_files The most files read in lock-step at once, 0 for as many as
+ * fit LOCKSTEP_BUFFER_BYTES.
+ */
+FileClasses
+compare_files_lockstep_chunked(const std::vector<std::string> &filenames,
+                               size_t max_chunk, size_t max_files) {
+  if (max_files == 0)
+    max_files = LOCKSTEP_BUFFER_BYTES / PageCache::alignment;
+  max_files = std::max<size_t>(max_files, 2);
+  if (filenames.size() <= max_files)
+    return lockstep(filenames, max_chunk);
+
+  FileClasses classes;
+  std::vector<size_t> left(filenames.size());
+  std::iota(left.begin(), left.end(), 0);
+  std::vector<std::string> batch;
+  while (!left.empty()) {
+    const size_t r = left.front();
+    std::vector<size_t> same, rest;
+    bool readable = false;
+    for (size_t begin = 1; begin < left.size(); begin += max_files - 1) {
+      const size_t end = std::min(begin + max_files - 1, left.size());
+      batch.assign({filenames.at(r)});
+      for (size_t k = begin; k < end; ++k)
+        batch.push_back(filenames.at(left.at(k)));
+      // Files which could not be read are in no class and are dropped.
+      for (const auto &c : lockstep(batch, max_chunk)) {
+        bool with_r = c.front() == 0;
+        readable = readable || with_r;
+        for (size_t k : c)
+          if (k != 0)
+            (with_r ? same : rest).push_back(left.at(begin + k - 1));
+      }
+    }
+    if (left.size() == 1)
+      readable = !lockstep({filenames.at(r)}, max_chunk).empty();
+    if (readable) {
+      same.insert(same.begin(), r);
+      classes.push_back(std::move(same));
+    }
+    std::sort(rest.begin(), rest.end());
+    left = std::move(rest);
+  }
+  return classes;
 }
@@ -18,8 +18,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // SPDX-License-Identifier: AGPL-3.0
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
 #pragma once
+#include <stddef.h> // for size_t
+
 #include <iterator>
 #include <string>
+#include <vector>
 
 // TODO: Readup!
 // Initial version taken from:
@@ -28,3 +31,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 using II = std::istreambuf_iterator<char>;
 bool compare_files_fdupes(const std::string &filename_1,
                           const std::string &filename2);
+
+using FileClasses = std::vector<std::vector<size_t>>;
+FileClasses compare_files_lockstep(const std::vector<std::string> &filenames);
+FileClasses
+compare_files_lockstep_chunked(const std::vector<std::string> &filenames,
+                               size_t max_chunk, size_t max_files = 0);
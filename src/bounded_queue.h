@@ -0,0 +1,133 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t, ptrdiff_t
+
+#include <atomic>  // for atomic
+#include <chrono>  // for microseconds
+#include <memory>  // for unique_ptr
+#include <thread>  // for yield, sleep_for
+#include <utility> // for move
+
+/**
+ * @brief A bounded multi-producer multi-consumer queue.  The cells form a ring
+ * and every cell carries a sequence number telling whether it is ready to be
+ * written or read in the current lap, so producers and consumers only contend
+ * on one atomic each and never take a lock (the queue of Dmitry Vyukov).
+ * push() and pop() back off while the queue is full or empty.
+ */
+template <class T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+      size *= 2;
+    cells = std::make_unique<Cell[]>(size);
+    for (size_t i = 0; i < size; ++i)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    mask = size - 1;
+  }
+
+  /**
+   * @brief Add an item unless the queue is full.
+   *
+   * @param item The item, moved from on success.
+   *
+   * @return true if the item was added and false otherwise.
+   */
+  bool try_push(T &item) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[pos & mask];
+      ptrdiff_t diff = static_cast<ptrdiff_t>(
+          cell.sequence.load(std::memory_order_acquire) - pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          cell.data = std::move(item);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0)
+        return false;
+      else
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Take the oldest item unless the queue is empty.
+   *
+   * @param item Set to the item on success.
+   *
+   * @return true if an item was taken and false otherwise.
+   */
+  bool try_pop(T &item) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[pos & mask];
+      ptrdiff_t diff = static_cast<ptrdiff_t>(
+          cell.sequence.load(std::memory_order_acquire) - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          item = std::move(cell.data);
+          cell.sequence.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0)
+        return false;
+      else
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  void push(T item) {
+    for (size_t spins = 0; !try_push(item); ++spins)
+      back_off(spins);
+  }
+
+  T pop() {
+    T item;
+    for (size_t spins = 0; !try_pop(item); ++spins)
+      back_off(spins);
+    return item;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+  alignas(64) std::atomic<size_t> enqueue_pos{0};
+  alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+  // Yield for a while, then sleep, so a stage waiting on a slow one (such as
+  // the reader of a pipe) does not keep a core busy.
+  static void back_off(size_t spins) {
+    if (spins < 64)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+};
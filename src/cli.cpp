@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "cxxopts.hpp"
 
@@ -45,13 +46,66 @@ void add_options(cxxopts::Options &options, int argc, char *argv[]) {
     ("y,dry-run", "Do a dry run (i.e. do not delete files). Pass a file to write to.",
      cxxopts::value<std::string>())
 
+    ("t,threads", "Number of threads used for hashing and comparing files.",
+     cxxopts::value<size_t>()->default_value("1"))
+
+    ("f,files-from", "Read the NUL separated paths from this file instead of stdin.",
+     cxxopts::value<std::string>())
+
+    ("w,walk", "Walk these directories, instead of reading paths, comma separated.",
+     cxxopts::value<std::vector<std::string>>())
+
+    ("type", "With --walk, take regular files (f), symlinks to files (l) or both (fl).",
+     cxxopts::value<std::string>()->default_value("f"))
+
+    ("min-size", "With --walk, skip the files smaller than this many bytes.",
+     cxxopts::value<uint64_t>())
+
+    ("max-size", "With --walk, skip the files larger than this many bytes.",
+     cxxopts::value<uint64_t>())
+
+    ("xdev", "With --walk, do not descend into other filesystems.")
+
+    ("format", "Print the sets as one JSON document (json) or one JSON object per line (ndjson).",
+     cxxopts::value<std::string>()->default_value("json"))
+
+    ("stats", "Write statistics about every stage of the pipeline to this file as JSON.",
+     cxxopts::value<std::string>())
+
+    ("eager", "Hash the first 4KB of files as soon as another file of their size is read, not with --walk.")
+
+    ("sort-reads", "Read the files in the order they lie on disk, for spinning disks.")
+
+    ("c,cache", "Keep the file hashes in this file and reuse them on the next run.",
+     cxxopts::value<std::string>())
+
+    ("queue-depth", "Number of reads kept in flight while hashing, io_uring is used above 1.",
+     cxxopts::value<size_t>()->default_value("1"))
+
+    ("mmap-threshold", "Files of at least this many bytes are hashed through mmap, 0 disables it.",
+     cxxopts::value<uint64_t>()->default_value("67108864"))
+
+    ("direct-io", "Read the files with O_DIRECT, leaving what other programs have in the page cache.")
+
+    ("max-read-rate", "Read at most this many bytes a second.",
+     cxxopts::value<uint64_t>())
+
+    ("max-iops", "Do at most this many reads a second.",
+     cxxopts::value<uint64_t>())
+
+    ("idle", "Only use the CPU and the disks when nothing else does.")
+
+    ("control-file", "Take max-read-rate and max-iops from this file, and again on SIGHUP.",
+     cxxopts::value<std::string>())
+
     ("h,help", "Print usage")
     ;
 
   // clang-format on
   cxxopts_results = options.parse(argc, argv);
   check_options();
-  if (isatty(fileno(stdin))) {
+  if (isatty(fileno(stdin)) && !cxxopts_results.count("files-from") &&
+      !cxxopts_results.count("walk")) {
     std::cout << options.help() << std::endl;
     exit(0);
   }
@@ -81,6 +135,41 @@ void check_options() {
   if (cxxopts_results.count("dry-run") && !cxxopts_results.count("delete"))
     throw std::runtime_error("Incompatible options.");
 
+  // Only one source of paths.
+  if (cxxopts_results.count("walk") && cxxopts_results.count("files-from"))
+    throw std::runtime_error("Incompatible options.");
+
+  // A walk has all the paths before any file is added.
+  if (cxxopts_results.count("walk") && cxxopts_results.count("eager"))
+    throw std::runtime_error("Incompatible options.");
+
+  // The predicates only apply to a walk.
+  if (!cxxopts_results.count("walk") &&
+      (cxxopts_results.count("type") || cxxopts_results.count("min-size") ||
+       cxxopts_results.count("max-size") || cxxopts_results.count("xdev")))
+    throw std::runtime_error("Incompatible options.");
+
+  // Only the sets printed have a format.
+  if (cxxopts_results.count("format") &&
+      (cxxopts_results.count("summary") || cxxopts_results.count("delete")))
+    throw std::runtime_error("Incompatible options.");
+
+  // Mapped files are read through the page cache.
+  if (cxxopts_results.count("direct-io") &&
+      cxxopts_results.count("mmap-threshold"))
+    throw std::runtime_error("Incompatible options.");
+
+  std::string format = cxxopts_results["format"].as<std::string>();
+  if (format != "json" && format != "ndjson")
+    throw std::runtime_error("The format option takes json or ndjson.");
+
+  std::string type = cxxopts_results["type"].as<std::string>();
+  if (type != "f" && type != "l" && type != "fl" && type != "lf")
+    throw std::runtime_error("The type option takes f, l or fl.");
+
+  if (cxxopts_results["threads"].as<size_t>() == 0)
+    throw std::runtime_error("The threads option takes a positive number.");
+
   if (cxxopts_results.count("dry-run")) {
     if (cxxopts_results["dry-run"].as<std::string>().at(0) == '-') {
       throw std::runtime_error(
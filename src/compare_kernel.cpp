@@ -0,0 +1,264 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "compare_kernel.h"
+
+#include <stdint.h> // for uint64_t
+#include <string.h> // for memcpy
+
+#include <algorithm> // for min
+#include <atomic>    // for atomic
+#include <stdexcept> // for invalid_argument
+#include <string>    // for string
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // for __m128i, __m256i, __m512i
+#define UNDUPES_X86 1
+#endif
+
+namespace {
+using Kernel = size_t (*)(const unsigned char *, const unsigned char *, size_t);
+
+// first_differences() compares the reference a block at a time against
+// every candidate, so the block stays in the L1 cache.
+constexpr size_t reference_block = 16 * (1 << 10);
+
+size_t first_difference_scalar(const unsigned char *a, const unsigned char *b,
+                               size_t size) {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t x, y;
+    memcpy(&x, a + i, sizeof(x));
+    memcpy(&y, b + i, sizeof(y));
+    if (x != y)
+      break;
+  }
+  for (; i < size; ++i)
+    if (a[i] != b[i])
+      return i;
+  return size;
+}
+
+#ifdef UNDUPES_X86
+__attribute__((target("sse2"))) size_t
+first_difference_sse2(const unsigned char *a, const unsigned char *b,
+                      size_t size) {
+  auto equal = [a, b](size_t i) {
+    return _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+  };
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m128i all = _mm_and_si128(_mm_and_si128(equal(i), equal(i + 16)),
+                                _mm_and_si128(equal(i + 32), equal(i + 48)));
+    if (_mm_movemask_epi8(all) != 0xffff)
+      break;
+  }
+  for (; i + 16 <= size; i += 16) {
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(equal(i)));
+    if (mask != 0xffff)
+      return i + static_cast<size_t>(__builtin_ctz(~mask));
+  }
+  return i + first_difference_scalar(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t
+first_difference_avx2(const unsigned char *a, const unsigned char *b,
+                      size_t size) {
+  auto equal = [a, b](size_t i) __attribute__((target("avx2"))) {
+    return _mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+  };
+  size_t i = 0;
+  for (; i + 128 <= size; i += 128) {
+    __m256i all =
+        _mm256_and_si256(_mm256_and_si256(equal(i), equal(i + 32)),
+                         _mm256_and_si256(equal(i + 64), equal(i + 96)));
+    if (static_cast<unsigned>(_mm256_movemask_epi8(all)) != 0xffffffff)
+      break;
+  }
+  for (; i + 32 <= size; i += 32) {
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(equal(i)));
+    if (mask != 0xffffffff)
+      return i + static_cast<size_t>(__builtin_ctz(~mask));
+  }
+  return i + first_difference_sse2(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx512f,avx512bw"))) size_t
+first_difference_avx512(const unsigned char *a, const unsigned char *b,
+                        size_t size) {
+  auto differ = [a, b](size_t i) __attribute__((target("avx512f,avx512bw"))) {
+    return _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a + i),
+                                   _mm512_loadu_si512(b + i));
+  };
+  size_t i = 0;
+  for (; i + 256 <= size; i += 256)
+    if ((differ(i) | differ(i + 64) | differ(i + 128) | differ(i + 192)) != 0)
+      break;
+  for (; i + 64 <= size; i += 64) {
+    __mmask64 mask = differ(i);
+    if (mask != 0)
+      return i + static_cast<size_t>(__builtin_ctzll(mask));
+  }
+  // The tail with masked loads, which do not touch the bytes past it.
+  if (i < size) {
+    __mmask64 tail = (__mmask64{1} << (size - i)) - 1;
+    __mmask64 mask = _mm512_mask_cmpneq_epi8_mask(
+        tail, _mm512_maskz_loadu_epi8(tail, a + i),
+        _mm512_maskz_loadu_epi8(tail, b + i));
+    if (mask != 0)
+      return i + static_cast<size_t>(__builtin_ctzll(mask));
+  }
+  return size;
+}
+#endif
+
+Kernel kernel(CompareKernel::Kind kind) {
+  switch (kind) {
+#ifdef UNDUPES_X86
+  case CompareKernel::Kind::sse2:
+    return first_difference_sse2;
+  case CompareKernel::Kind::avx2:
+    return first_difference_avx2;
+  case CompareKernel::Kind::avx512:
+    return first_difference_avx512;
+#endif
+  default:
+    return first_difference_scalar;
+  }
+}
+
+std::atomic<CompareKernel::Kind> &active_kind() {
+  static std::atomic<CompareKernel::Kind> kind{CompareKernel::best()};
+  return kind;
+}
+
+std::atomic<Kernel> &active_kernel() {
+  static std::atomic<Kernel> function{kernel(active_kind().load())};
+  return function;
+}
+} // namespace
+
+/**
+ * @brief Whether the CPU, and the build, have a kernel.
+ */
+bool CompareKernel::supported(Kind kind) {
+#ifdef UNDUPES_X86
+  __builtin_cpu_init();
+  switch (kind) {
+  case Kind::scalar:
+    return true;
+  case Kind::sse2:
+    return __builtin_cpu_supports("sse2");
+  case Kind::avx2:
+    return __builtin_cpu_supports("avx2");
+  case Kind::avx512:
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+  }
+  return false;
+#else
+  return kind == Kind::scalar;
+#endif
+}
+
+/**
+ * @brief The fastest kernel the CPU has.
+ */
+CompareKernel::Kind CompareKernel::best() {
+  for (Kind kind : {Kind::avx512, Kind::avx2, Kind::sse2})
+    if (supported(kind))
+      return kind;
+  return Kind::scalar;
+}
+
+CompareKernel::Kind CompareKernel::active() {
+  return active_kind().load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Use a kernel instead of the best one, for tests and benchmarks.
+ * Throws an invalid_argument if the CPU does not have it.
+ */
+void CompareKernel::use(Kind kind) {
+  if (!supported(kind))
+    throw std::invalid_argument(
+        std::string("The CPU does not support the kernel: ") + name(kind));
+  active_kind().store(kind, std::memory_order_relaxed);
+  active_kernel().store(kernel(kind), std::memory_order_relaxed);
+}
+
+const char *CompareKernel::name(Kind kind) {
+  switch (kind) {
+  case Kind::sse2:
+    return "sse2";
+  case Kind::avx2:
+    return "avx2";
+  case Kind::avx512:
+    return "avx512";
+  default:
+    return "scalar";
+  }
+}
+
+/**
+ * @brief The first offset at which two buffers differ.
+ *
+ * @return The offset, or size if the buffers are equal.
+ */
+size_t CompareKernel::first_difference(const unsigned char *a,
+                                       const unsigned char *b, size_t size) {
+  return active_kernel().load(std::memory_order_relaxed)(a, b, size);
+}
+
+/**
+ * @brief Compare many buffers against a reference in one pass over it.
+ *
+ * @param reference The buffer the others are compared against.
+ * @param candidates The buffers compared, each of at least size bytes.
+ * @param count The number of candidates.
+ * @param size The bytes to compare.
+ * @param offsets Set to the first offset at which every candidate differs
+ * from the reference, or to size for the candidates equal to it.
+ */
+void CompareKernel::first_differences(const unsigned char *reference,
+                                      const unsigned char *const *candidates,
+                                      size_t count, size_t size,
+                                      size_t *offsets) {
+  Kernel compare = active_kernel().load(std::memory_order_relaxed);
+  for (size_t c = 0; c < count; ++c)
+    offsets[c] = size;
+  size_t equal = count;
+  for (size_t start = 0; start < size && equal > 0;
+       start += reference_block) {
+    size_t length = std::min(reference_block, size - start);
+    for (size_t c = 0; c < count; ++c) {
+      if (offsets[c] != size)
+        continue;
+      size_t offset = compare(reference + start, candidates[c] + start, length);
+      if (offset != length) {
+        offsets[c] = start + offset;
+        --equal;
+      }
+    }
+  }
+}
@@ -0,0 +1,44 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+
+/**
+ * @brief Byte comparison kernels for verifying duplicates.  A scalar kernel
+ * and, on x86, SSE2, AVX2 and AVX-512 ones, of which the best the CPU has is
+ * picked at runtime.  They find the first offset at which two buffers differ,
+ * which memcmp() does not tell.
+ */
+namespace CompareKernel {
+enum class Kind { scalar, sse2, avx2, avx512 };
+constexpr Kind kinds[] = {Kind::scalar, Kind::sse2, Kind::avx2, Kind::avx512};
+
+bool supported(Kind kind);
+Kind best();
+Kind active();
+void use(Kind kind);
+const char *name(Kind kind);
+
+size_t first_difference(const unsigned char *a, const unsigned char *b,
+                        size_t size);
+void first_differences(const unsigned char *reference,
+                       const unsigned char *const *candidates, size_t count,
+                       size_t size, size_t *offsets);
+} // namespace CompareKernel
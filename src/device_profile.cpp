@@ -0,0 +1,147 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "device_profile.h"
+
+#include <sys/statfs.h>    // for statfs
+#include <sys/sysmacros.h> // for major, minor
+
+#include <fstream>       // for ifstream
+#include <mutex>         // for mutex, lock_guard
+#include <string>        // for string, to_string
+#include <unordered_map> // for unordered_map
+
+#include "debug.h" // for info
+
+namespace {
+std::mutex profiles_mutex;
+std::unordered_map<uint64_t, DeviceProfile> profiles;
+
+// statfs() types of the network and userspace filesystems.
+constexpr long network_types[] = {
+    0x6969,              // NFS
+    0x517b,              // SMB
+    static_cast<long>(0xff534d42), // CIFS
+    static_cast<long>(0xfe534d42), // SMB2
+    0x00c36400,          // Ceph
+    0x65735546,          // FUSE
+    0x47504653,          // GPFS
+    0x0bd00bd0,          // Lustre
+};
+
+/**
+ * @brief The queue/rotational attribute of a block device, or of the disk a
+ * partition is on.
+ */
+bool read_rotational(unsigned maj, unsigned min, bool &rotational) {
+  std::string dir =
+      "/sys/dev/block/" + std::to_string(maj) + ":" + std::to_string(min);
+  for (const char *attr : {"/queue/rotational", "/../queue/rotational"}) {
+    std::ifstream in{dir + attr};
+    int value;
+    if (in >> value) {
+      rotational = value != 0;
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
+/**
+ * @brief The profile of a kind of device.
+ */
+DeviceProfile DeviceProfile::for_kind(Kind kind) {
+  DeviceProfile profile;
+  profile.kind = kind;
+  switch (kind) {
+  case Kind::solid_state:
+    break;
+  case Kind::rotational:
+    profile.queue_depth = 1;
+    profile.block_size = 1 << 20;
+    profile.max_active = 1;
+    break;
+  case Kind::network:
+    profile.block_size = 1 << 20;
+    profile.max_active = 2;
+    break;
+  }
+  return profile;
+}
+
+const char *DeviceProfile::name() const {
+  switch (kind) {
+  case Kind::rotational:
+    return "rotational";
+  case Kind::network:
+    return "network";
+  default:
+    return "solid state";
+  }
+}
+
+/**
+ * @brief Find out the kind of a device.
+ *
+ * @param dev The st_dev of a file on it.
+ * @param path The file, for the devices without sysfs attributes.
+ */
+DeviceProfile::Kind DeviceProfiles::detect(uint64_t dev, const char *path) {
+  bool rotational;
+  if (major(dev) != 0 && read_rotational(major(dev), minor(dev), rotational))
+    return rotational ? DeviceProfile::Kind::rotational
+                      : DeviceProfile::Kind::solid_state;
+  struct statfs fs;
+  if (path != nullptr && statfs(path, &fs) == 0)
+    for (long type : network_types)
+      if (static_cast<long>(fs.f_type) == type)
+        return DeviceProfile::Kind::network;
+  return DeviceProfile::Kind::solid_state;
+}
+
+/**
+ * @brief The profile of a device, detected the first time it is asked for.
+ *
+ * @param dev The st_dev of a file on the device.
+ * @param path The file.
+ */
+const DeviceProfile &DeviceProfiles::get(uint64_t dev, const char *path) {
+  {
+    const std::lock_guard<std::mutex> lock(profiles_mutex);
+    auto it = profiles.find(dev);
+    if (it != profiles.end())
+      return it->second;
+  }
+  DeviceProfile profile = DeviceProfile::for_kind(detect(dev, path));
+  const std::lock_guard<std::mutex> lock(profiles_mutex);
+  auto [it, inserted] = profiles.emplace(dev, profile);
+  if (inserted)
+    spdlog::info("Device {}:{} is {}.", major(dev), minor(dev),
+                 it->second.name());
+  return it->second;
+}
+
+/**
+ * @brief Set the profile of a device instead of detecting it.
+ */
+void DeviceProfiles::set(uint64_t dev, const DeviceProfile &profile) {
+  const std::lock_guard<std::mutex> lock(profiles_mutex);
+  profiles[dev] = profile;
+}
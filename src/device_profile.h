@@ -0,0 +1,54 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+/**
+ * @brief How the files of a device are best read.  Solid state devices take
+ * many reads in flight, a spinning disk wants one stream of large reads at a
+ * time, and a network filesystem wants large reads and must not hold up the
+ * local devices while it answers.
+ */
+struct DeviceProfile {
+  enum class Kind { solid_state, rotational, network };
+  Kind kind{Kind::solid_state};
+  // The reads kept in flight, 0 for the --queue-depth setting.
+  size_t queue_depth{0};
+  // The size of every read, and of the chunks files are compared in.
+  size_t block_size{64 * (1 << 10)};
+  // The size groups of the device verified at a time, 0 for no limit.
+  size_t max_active{0};
+
+  static DeviceProfile for_kind(Kind kind);
+  const char *name() const;
+};
+
+/**
+ * @brief The profiles of the devices seen so far, by st_dev.  A block device
+ * is told rotational or not by its queue/rotational attribute in sysfs.  A
+ * filesystem without a block device of its own is told network or not by its
+ * statfs() type.  Anything unknown is taken for solid state.
+ */
+namespace DeviceProfiles {
+DeviceProfile::Kind detect(uint64_t dev, const char *path);
+const DeviceProfile &get(uint64_t dev, const char *path);
+void set(uint64_t dev, const DeviceProfile &profile);
+} // namespace DeviceProfiles
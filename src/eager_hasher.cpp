@@ -0,0 +1,97 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "eager_hasher.h"
+
+#include <utility> // for move
+
+/**
+ * @brief Construct an EagerHasher.
+ *
+ * @param _table The table the files are added to.
+ * @param _pool The pool the heads are hashed on, nullptr to hash them on the
+ * calling thread.
+ */
+EagerHasher::EagerHasher(FileTable &_table, ThreadPool *_pool)
+    : table(_table), pool(_pool) {}
+
+/**
+ * @brief Take note of a file just added to the table, and queue it for
+ * hashing if another file of its size has been seen.  Another path to an inode
+ * already seen is skipped.
+ *
+ * @param i The index of the file.
+ */
+void EagerHasher::added(FileTable::Index i) {
+  if (!inodes.insert(DevIno{table.dev(i), table.ino(i)}).second)
+    return;
+  auto [size_index, inserted] = sizes.insert(table.file_size(i));
+  if (inserted) {
+    first_of_size.push_back(i);
+    return;
+  }
+  FileTable::Index &first = first_of_size.at(size_index);
+  if (first != queued) {
+    queue(first);
+    first = queued;
+  }
+  queue(i);
+}
+
+void EagerHasher::queue(FileTable::Index i) {
+  pending.files.push_back(i);
+  pending.paths.push_back(table.path(i));
+  if (pending.files.size() == batch_size)
+    flush();
+}
+
+/**
+ * @brief Hash the queued files, in a task of the pool when there is one.
+ */
+void EagerHasher::flush() {
+  if (pending.files.empty())
+    return;
+  Batch &batch = batches.emplace_back(std::move(pending));
+  pending = Batch{};
+  auto task = [&batch]() {
+    batch.heads = FiltersList::xxhash_heads(batch.paths);
+  };
+  if (pool == nullptr)
+    task();
+  else
+    pool->submit(task);
+}
+
+/**
+ * @brief Wait for the heads queued so far and store them in the table.  Must
+ * not be called from a worker of the pool.
+ */
+void EagerHasher::finish() {
+  flush();
+  if (pool != nullptr)
+    pool->wait();
+  for (auto &batch : batches) {
+    for (size_t j = 0; j < batch.files.size(); ++j)
+      if (batch.heads.at(j)) {
+        table.set_head(batch.files.at(j), *batch.heads.at(j));
+        ++hashed;
+      }
+  }
+  batches.clear();
+}
@@ -0,0 +1,73 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <deque>  // for deque
+#include <string> // for string
+#include <vector> // for vector
+
+#include "file_table.h"     // for FileTable
+#include "filters_list.h"   // for DevIno, FiltersList::HashVector
+#include "flat_index_map.h" // for FlatIndexMap
+#include "thread_pool.h"    // for ThreadPool
+
+/**
+ * @brief Hashes the heads of files while the input is still coming in.  It is
+ * told about every file added to the table, keeps an index of the sizes seen
+ * so far, and once a size has a second file, hashes the first 4KB of both on
+ * the pool, and of every later file of that size as it arrives.  Files are
+ * counted by device and inode: a second path to an inode is collapsed by
+ * TableSameInodeFilter before the heads are used, so it is neither hashed nor
+ * makes its size seen twice.  By the end of the input only the files with a
+ * size of their own are left unhashed, and finish() puts the heads in the
+ * table for xxhash_progressive.
+ */
+class EagerHasher {
+public:
+  EagerHasher(FileTable &_table, ThreadPool *_pool);
+  void added(FileTable::Index i);
+  void finish();
+  size_t num_hashed() const { return hashed; }
+
+private:
+  struct Batch {
+    std::vector<FileTable::Index> files;
+    std::vector<std::string> paths;
+    FiltersList::HashVector heads;
+  };
+  static constexpr size_t batch_size = 64;
+  static constexpr FileTable::Index queued = UINT32_MAX;
+
+  FileTable &table;
+  ThreadPool *pool;
+  FlatIndexMap<DevIno> inodes;
+  FlatIndexMap<uint64_t> sizes;
+  // The first file of each size, queued once the size has been seen twice.
+  std::vector<FileTable::Index> first_of_size;
+  // Batches are only ever added at the end, so a task can hold on to one.
+  std::deque<Batch> batches;
+  Batch pending;
+  size_t hashed{0};
+
+  void queue(FileTable::Index i);
+  void flush();
+};
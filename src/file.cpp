@@ -19,6 +19,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
 #include "file.h"
 
+#include <fcntl.h>         // for AT_FDCWD, AT_EACCESS, AT_STATX_SYNC_AS_STAT
+#include <sys/stat.h>      // for statx, S_ISREG, S_ISDIR
+#include <sys/sysmacros.h> // for makedev
+#include <unistd.h>        // for faccessat, R_OK
+
 #include <ostream> // for operator<<, char_traits, basic_ostream
 #include <set>
 #include <string_view> // for operator==, basic_string_view, operator""sv
@@ -58,27 +63,114 @@ std::ostream &operator<<(std::ostream &os, const FileType &obj) {
   return os;
 }
 
+namespace {
+FileType classify(bool symlink, const std::optional<FileStat> &file_stat) {
+  if (symlink && !file_stat)
+    return FileType::broken_symlink;
+  if (!file_stat)
+    return FileType::other;
+  if (S_ISREG(file_stat->mode))
+    return symlink ? FileType::symlinked_file : FileType::regular_file;
+  if (S_ISDIR(file_stat->mode))
+    return symlink ? FileType::symlinked_dir : FileType::regular_dir;
+  return FileType::other;
+}
+} // namespace
+
 /**
- * @brief The FileType for the file represented by the class
+ * @brief statx() a path.
+ *
+ * @param dirfd The directory a relative path is looked up in, AT_FDCWD for the
+ * working directory.
+ * @param path The path.
+ * @param flags 0 to follow symlinks, AT_SYMLINK_NOFOLLOW otherwise.
+ *
+ * @return The metadata, or nothing if the path cannot be stat'ed.
+ */
+std::optional<FileStat> stat_at(int dirfd, const char *path, int flags) {
+  struct statx stx;
+  if (statx(dirfd, path, flags | AT_STATX_SYNC_AS_STAT, STATX_BASIC_STATS,
+            &stx) != 0)
+    return std::nullopt;
+  return FileStat{stx.stx_size,
+                  makedev(stx.stx_dev_major, stx.stx_dev_minor),
+                  stx.stx_ino,
+                  stx.stx_blocks,
+                  stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec,
+                  stx.stx_ctime.tv_sec * 1000000000LL + stx.stx_ctime.tv_nsec,
+                  stx.stx_mode,
+                  stx.stx_uid,
+                  stx.stx_gid};
+}
+
+/**
+ * @brief Read the metadata of the file with one statx(), following symlinks,
+ * and work out the FileType from it.  Whether the path itself is a symlink is
+ * known from the directory_entry already.  Paths which cannot be stat'ed are
+ * left without metadata.
+ */
+void File::probe() {
+  file_stat = stat_at(AT_FDCWD, dir_entry.path().c_str(), 0);
+  file_type = classify(dir_entry.is_symlink(), file_stat);
+}
+
+/**
+ * @brief Work out the FileType and metadata of a path without a File.  A
+ * single statx() is made unless the path is a symlink, which is then stat'ed
+ * a second time to follow it.
+ *
+ * @param path The path, NUL terminated.
+ * @param file_stat Set to the metadata of the file the path leads to, nothing
+ * if it cannot be stat'ed.
+ *
+ * @return The FileType of the path.
+ */
+FileType probe_path(const char *path, std::optional<FileStat> &file_stat) {
+  file_stat = stat_at(AT_FDCWD, path, AT_SYMLINK_NOFOLLOW);
+  bool symlink = file_stat && S_ISLNK(file_stat->mode);
+  if (symlink)
+    file_stat = stat_at(AT_FDCWD, path, 0);
+  return classify(symlink, file_stat);
+}
+
+/**
+ * @brief Whether the process may read the file, asked of the kernel with the
+ * effective ids, so ACLs and capabilities count as they would for open().
+ *
+ * @param dirfd The directory a relative path is looked up from, or AT_FDCWD.
+ * @param path The path, NUL terminated.
  *
- * @return The FileType object.
+ * @return true if the file is readable and false otherwise.
  */
-FileType File::get_file_type() const {
-  // Symlinks return 1 for is_regular_file when passed as paths.
-  if (dir_entry.is_regular_file() && !dir_entry.is_symlink())
-    return FileType::regular_file;
-  else if (dir_entry.is_directory() && !dir_entry.is_symlink())
-    return FileType::regular_dir;
-  else if (dir_entry.is_symlink()) {
-    fs::directory_entry resolved_dir_entry = get_resolved_dir_entry();
-    if (!fs::exists(dir_entry.path()))
-      return FileType::broken_symlink;
-    if (resolved_dir_entry.is_regular_file())
-      return FileType::symlinked_file;
-    if (resolved_dir_entry.is_directory())
-      return FileType::symlinked_dir;
+bool is_readable(int dirfd, const char *path) {
+  return faccessat(dirfd, path, R_OK, AT_EACCESS) == 0;
+}
+
+/**
+ * @brief Check whether a path is of an accepted type and readable, logging
+ * why it is skipped otherwise.
+ *
+ * @param path The path.
+ * @param file_type The FileType of the path.
+ * @param file_stat The metadata of the path.
+ * @param readable Whether is_readable() holds for the path.
+ * @param accepted A set of FileTypes.
+ *
+ * @return true if the path is of the accepted type and readable, false
+ * otherwise.
+ */
+bool check_type_or_log(std::string_view path, FileType file_type,
+                       const std::optional<FileStat> &file_stat, bool readable,
+                       const std::set<FileType> &accepted) {
+  if (accepted.find(file_type) == accepted.end()) {
+    spdlog::warn("Path not a file or a symlink to a file, skipping: {}", path);
+    return false;
   }
-  return FileType::other;
+  if (!file_stat || !readable) {
+    spdlog::warn("Could not open file, skipping: {}", path);
+    return false;
+  }
+  return true;
 }
 
 /**
@@ -139,19 +231,7 @@ std::string File::get_path() const { return this->dir_entry.path().string(); }
  * an spdlog.
  */
 bool File::check_file_or_log(const std::set<FileType> &accepted) const {
-  if (accepted.find(this->get_file_type()) == accepted.end()) {
-    spdlog::warn("Path not a file or a symlink to a file, skipping: {}",
-                 this->get_path());
-    return false;
-  }
-
-  std::ifstream ifs;
-  ifs.open(this->get_path(), std::ios_base::in);
-  if (!ifs.good()) {
-    spdlog::warn("Could not open file, skipping: {}", this->get_path());
-    return false;
-  }
-
-  ifs.close();
-  return true;
+  std::string path = get_path();
+  return check_type_or_log(path, file_type, file_stat,
+                           is_readable(AT_FDCWD, path.c_str()), accepted);
 }
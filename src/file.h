@@ -19,12 +19,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
 #pragma once
 #include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t, int64_t, uint32_t
 
 #include <filesystem> // for directory_entry
 #include <fstream>
-#include <ostream> // for ostream
+#include <optional> // for optional
+#include <ostream>  // for ostream
 #include <set>
-#include <string> // for basic_string, string
+#include <string>      // for basic_string, string
+#include <string_view> // for string_view
 
 #include "debug.h"
 
@@ -44,17 +47,43 @@ enum class FileType {
 
 std::ostream &operator<<(std::ostream &os, const FileType &obj);
 
+/**
+ * @brief The metadata of the file a path leads to, symlinks followed.
+ */
+struct FileStat {
+  uint64_t size;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t blocks;
+  int64_t mtime_ns;
+  int64_t ctime_ns;
+  uint32_t mode;
+  uint32_t uid;
+  uint32_t gid;
+};
+
+std::optional<FileStat> stat_at(int dirfd, const char *path, int flags);
+FileType probe_path(const char *path, std::optional<FileStat> &file_stat);
+bool is_readable(int dirfd, const char *path);
+bool check_type_or_log(std::string_view path, FileType file_type,
+                       const std::optional<FileStat> &file_stat, bool readable,
+                       const std::set<FileType> &accepted);
+
 /**
  * @brief The File class.  This is used for representing file objects.  They
  * could be a file/directory/symlink etc. like mentioned in the FileType class.
+ * The metadata is read with a single statx() when the File is created and
+ * every later stage uses the copy kept here.
  */
 class File {
 public:
   fs::directory_entry dir_entry;
   size_t index;
-  explicit File(const std::string &path)
-      : dir_entry{path}, index{}, file_type{this->get_file_type()} {}
-  FileType get_file_type() const;
+  explicit File(const std::string &path) : dir_entry{path}, index{} {
+    probe();
+  }
+  FileType get_file_type() const { return file_type; }
+  const std::optional<FileStat> &get_stat() const { return file_stat; }
   std::string get_path() const;
 
   // TODO: Remove this.
@@ -63,10 +92,12 @@ public:
   bool check_file_or_log(const std::set<FileType> &accepted) const;
 
 private:
-  FileType file_type;
+  FileType file_type{FileType::other};
+  std::optional<FileStat> file_stat;
   friend std::ostream &operator<<(std::ostream &os, const File &obj);
   friend bool operator==(const File &l, const File &r);
 
+  void probe();
   bool is_nonbroken_symlink() const;
   std::string time_string() const;
 };
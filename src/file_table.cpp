@@ -0,0 +1,59 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "file_table.h"
+
+#include <limits>    // for numeric_limits
+#include <stdexcept> // for runtime_error
+
+/**
+ * @brief Append a file to the table.
+ *
+ * @param path The path of the file.
+ * @param file_stat The metadata of the file.
+ *
+ * @return The index of the file and a runtime_error if the table is full.
+ */
+FileTable::Index FileTable::add(std::string_view path,
+                                const FileStat &file_stat) {
+  if (size() >= std::numeric_limits<Index>::max())
+    throw std::runtime_error("Too many files.");
+  paths.add(path);
+  sizes.push_back(file_stat.size);
+  devs.push_back(file_stat.dev);
+  inos.push_back(file_stat.ino);
+  mtimes.push_back(file_stat.mtime_ns);
+  ctimes.push_back(file_stat.ctime_ns);
+  digests.push_back(Hash128{0, 0});
+  heads.push_back(Hash128{0, 0});
+  has_heads.push_back(false);
+  return static_cast<Index>(size() - 1);
+}
+
+void FileTable::reserve(size_t num_files) {
+  paths.reserve(num_files);
+  sizes.reserve(num_files);
+  devs.reserve(num_files);
+  inos.reserve(num_files);
+  mtimes.reserve(num_files);
+  ctimes.reserve(num_files);
+  digests.reserve(num_files);
+  heads.reserve(num_files);
+  has_heads.reserve(num_files);
+}
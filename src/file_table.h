@@ -0,0 +1,131 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint32_t, uint64_t, int64_t
+
+#include <functional>  // for hash
+#include <span>        // for span
+#include <string>      // for string
+#include <string_view> // for string_view
+#include <vector>      // for vector
+
+#include "file.h"       // for FileStat
+#include "path_store.h" // for PathStore
+
+/**
+ * @brief A 128 bit XXH3 digest.  It stays binary through the filters and is
+ * only turned into hex when printed.
+ */
+struct Hash128 {
+  uint64_t low64;
+  uint64_t high64;
+  bool operator==(const Hash128 &other) const = default;
+};
+
+template <> struct std::hash<Hash128> {
+  size_t operator()(const Hash128 &h) const noexcept {
+    return h.low64 ^ h.high64;
+  }
+};
+
+/**
+ * @brief Groups of files as spans of one flat array of indices into a
+ * FileTable.  A filter stage appends the groups it keeps, so no group is
+ * copied as a vector of its own.
+ */
+class IndexGroups {
+public:
+  using Index = uint32_t;
+
+  size_t size() const { return starts.size() - 1; }
+  bool empty() const { return size() == 0; }
+  size_t num_indices() const { return indices.size(); }
+  std::span<const Index> operator[](size_t group) const {
+    return {indices.data() + starts[group], starts[group + 1] - starts[group]};
+  }
+
+  void add(std::span<const Index> group) {
+    indices.insert(indices.end(), group.begin(), group.end());
+    starts.push_back(indices.size());
+  }
+
+private:
+  std::vector<Index> indices;
+  std::vector<size_t> starts{0};
+};
+
+/**
+ * @brief The files of a run in struct-of-arrays layout.  A file is a uint32_t
+ * index into every column, and the paths are kept in a PathStore, so a file
+ * costs a few tens of bytes plus its file name.
+ */
+class FileTable {
+public:
+  using Index = uint32_t;
+
+  Index add(std::string_view path, const FileStat &file_stat);
+  void reserve(size_t num_files);
+
+  size_t size() const { return sizes.size(); }
+  std::string path(Index i) const { return paths.path(i); }
+  void append_path(Index i, std::string &out) const {
+    paths.append_path(i, out);
+  }
+  uint64_t file_size(Index i) const { return sizes[i]; }
+  uint64_t dev(Index i) const { return devs[i]; }
+  uint64_t ino(Index i) const { return inos[i]; }
+  int64_t mtime_ns(Index i) const { return mtimes[i]; }
+  int64_t ctime_ns(Index i) const { return ctimes[i]; }
+
+  // The full hash of the file, set by the hashing stage for the files it
+  // found duplicates of.
+  const Hash128 &digest(Index i) const { return digests[i]; }
+  void set_digest(Index i, const Hash128 &hash) { digests[i] = hash; }
+
+  // The digest of the first 4KB, when it was hashed during ingestion.
+  bool has_head(Index i) const { return has_heads[i]; }
+  const Hash128 &head(Index i) const { return heads[i]; }
+  void set_head(Index i, const Hash128 &hash) {
+    heads[i] = hash;
+    has_heads[i] = true;
+  }
+
+  // Where the file lies on its device, see ReadOrder.  The column is only
+  // there once init_read_keys() has been called.
+  bool has_read_keys() const { return !read_keys.empty(); }
+  void init_read_keys() { read_keys.assign(size(), UINT64_MAX); }
+  uint64_t read_key(Index i) const { return read_keys[i]; }
+  void set_read_key(Index i, uint64_t key) { read_keys[i] = key; }
+
+private:
+  PathStore paths;
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> devs;
+  std::vector<uint64_t> inos;
+  std::vector<int64_t> mtimes;
+  std::vector<int64_t> ctimes;
+  std::vector<Hash128> digests;
+  std::vector<Hash128> heads;
+  // Bytes rather than bits, so the heads of different files can be set from
+  // different threads.
+  std::vector<uint8_t> has_heads;
+  std::vector<uint64_t> read_keys;
+};
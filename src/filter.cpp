@@ -20,8 +20,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "filter.h"
 
 #include <algorithm> // for find
+#include <numeric>   // for inclusive_scan
 #include <ostream>   // IWYU pragma: export
 
+#include "filters_list.h" // for DevIno
+
 /**
  * @brief Output stream operator for FilePtr class
  *
@@ -90,6 +93,84 @@ bool operator==(const FileSets &l, const FileSets &r) {
   return true;
 }
 
+/**
+ * @brief Collapse the paths sharing a device and inode.  Only the first path
+ * of an inode goes on to the content filters, the others are reported in
+ * same_inode_groups.
+ *
+ * @param table The files.
+ * @param groups The groups to collapse.
+ */
+TableSameInodeFilter::TableSameInodeFilter(const FileTable &table,
+                                           const IndexGroups &groups) {
+  std::vector<FileTable::Index> representatives;
+  std::vector<uint32_t> class_of;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    std::span<const FileTable::Index> group = groups[g];
+    FlatIndexMap<DevIno> seen{group.size()};
+    representatives.clear();
+    class_of.clear();
+    for (FileTable::Index i : group) {
+      auto [c, inserted] = seen.insert(DevIno{table.dev(i), table.ino(i)});
+      if (inserted)
+        representatives.push_back(i);
+      class_of.push_back(c);
+    }
+    add_classes(group, class_of, seen.size(), same_inode_groups);
+    new_groups.add(representatives);
+  }
+}
+
+/**
+ * @brief Append the classes of a group to `result` in the order of their first
+ * file, dropping the classes of a single file.
+ *
+ * @param group The group.
+ * @param class_of The class of every file of the group.
+ * @param num_classes The number of classes.
+ * @param result The groups to append to.
+ */
+void add_classes(std::span<const FileTable::Index> group,
+                 const std::vector<uint32_t> &class_of, size_t num_classes,
+                 IndexGroups &result) {
+  // A counting sort by class keeps the files of every class in input order.
+  std::vector<uint32_t> starts(num_classes + 1, 0);
+  for (uint32_t c : class_of)
+    ++starts[c + 1];
+  std::vector<uint32_t> sizes(starts.begin() + 1, starts.end());
+  std::inclusive_scan(starts.begin(), starts.end(), starts.begin());
+  std::vector<FileTable::Index> sorted(group.size());
+  std::vector<uint32_t> next(starts.begin(), starts.end() - 1);
+  for (size_t j = 0; j < group.size(); ++j)
+    sorted[next[class_of[j]]++] = group[j];
+  for (size_t c = 0; c < num_classes; ++c)
+    if (sizes[c] > 1)
+      result.add({sorted.data() + starts[c], sizes[c]});
+}
+
+/**
+ * @brief Make FileSets out of groups of a FileTable, for the code which still
+ * works on Files.  The index of every File is one more than its index in the
+ * table, so Files keep the input order.
+ *
+ * @param table The files.
+ * @param groups The groups.
+ *
+ * @return The FileSets.
+ */
+FileSets to_file_sets(const FileTable &table, const IndexGroups &groups) {
+  FileSets file_sets;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    FileVector files;
+    for (FileTable::Index i : groups[g]) {
+      files.emplace_back(std::make_shared<File>(table.path(i)));
+      files.back()->index = i + 1;
+    }
+    file_sets.emplace_back(std::move(files));
+  }
+  return file_sets;
+}
+
 /**
  * @brief The output stream operator for the uint64_t pair.  Maybe needed for
  * xxhash.
@@ -20,18 +20,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 #include <stdint.h> // for uint64_t
 
-#include <functional>    // for function
-#include <iostream>      // for basic_ostream, operator<<, cout, endl
-#include <list>          // for list, __list_iterator, operator!=
-#include <memory>        // for shared_ptr
-#include <ostream>       // for ostream
-#include <string>        // for basic_string, string
-#include <type_traits>   // for invoke_result
-#include <unordered_map> // for unordered_map
-#include <utility>       // for pair
-#include <vector>        // for vector
-
-#include "file.h" // for File
+#include <algorithm>   // for min
+#include <memory>      // for shared_ptr
+#include <ostream>     // for ostream
+#include <span>        // for span
+#include <string>      // for basic_string, string
+#include <type_traits> // for invoke_result
+#include <utility>     // for pair
+#include <vector>      // for vector
+
+#include "file.h"           // for File
+#include "file_table.h"     // for FileTable, IndexGroups
+#include "flat_index_map.h" // for FlatIndexMap
+#include "thread_pool.h"    // for ThreadPool
 
 using FilePtr = std::shared_ptr<File>;
 using FileVector = std::vector<FilePtr>;
@@ -46,71 +47,71 @@ bool operator==(const FilePtr &l, const FilePtr &r);
 bool operator==(const FileVector &l, const FileVector &r);
 bool operator==(const FileSets &l, const FileSets &r);
 
-template <class Attr> class Filter {
+FileSets to_file_sets(const FileTable &table, const IndexGroups &groups);
+
+/**
+ * @brief Groups the files by device and inode before any content is read.
+ * new_groups keeps the first index of every inode, in input order, and
+ * same_inode_groups holds the inodes reached through more than one path (hard
+ * links, bind mounts).
+ */
+class TableSameInodeFilter {
 public:
-  Filter(const FileSets &_file_sets, Attr _attr)
-      : file_sets{_file_sets}, attr{_attr} {};
-  FileSets file_sets;
-  FileSets new_file_sets;
-  Attr attr;
+  TableSameInodeFilter(const FileTable &table, const IndexGroups &groups);
+  IndexGroups new_groups;
+  IndexGroups same_inode_groups;
 };
 
-template <class Attr> class HashableFilter : public Filter<Attr> {
+void add_classes(std::span<const FileTable::Index> group,
+                 const std::vector<uint32_t> &class_of, size_t num_classes,
+                 IndexGroups &result);
+
+/**
+ * @brief Splits every group by a key.  Attr maps the table and an index to a
+ * key with == and std::hash defined, like FileTable::file_size.  The groups
+ * come out in the order their first file went in.
+ */
+template <class Attr> class TableHashableFilter {
 public:
-  // attr needs to have == and < defined.  We can reduce to just '=='.
-  HashableFilter(const FileSets &_file_sets, Attr _attr)
-      : Filter<Attr>{_file_sets, _attr} {
-    for (FileVector files : _file_sets) {
-      using ReturnType = typename std::invoke_result<Attr, FilePtr>::type;
-      std::unordered_map<ReturnType, FileVector> M;
-      for (auto &file : files) {
-        try {
-          M[_attr(file)].push_back(file);
-        } catch (const std::filesystem::filesystem_error &exp) {
-          spdlog::warn("Exception caught. \"{}\". Skipping file: {}",
-                       exp.what(), file->get_path());
-        }
-      }
-      for (auto const &[key, val] : M) {
-        if (val.size() > 1)
-          (Filter<Attr>::new_file_sets).push_back(std::move(val));
-      }
-    }
-  }
+  using Index = FileTable::Index;
+  using ReturnType = std::invoke_result_t<Attr, const FileTable &, Index>;
 
-  void print_with_filter(const FileSets &file_sets, Attr attr) const {
-    for (FileVector files : file_sets) {
-      for (auto &file : files) {
-        std::cout << file << " " << attr(file) << std::endl;
+  // With a pool, the keys are computed by the workers in slices of at most
+  // `grain` files; the grouping itself stays serial and in input order.
+  TableHashableFilter(const FileTable &table, const IndexGroups &groups,
+                      Attr attr, ThreadPool *pool = nullptr) {
+    std::vector<std::vector<ReturnType>> keys(groups.size());
+    for (size_t i = 0; i < groups.size(); ++i) {
+      std::span<const Index> group = groups[i];
+      keys.at(i).resize(group.size());
+      for (size_t begin = 0; begin < group.size(); begin += grain) {
+        size_t end = std::min(begin + grain, group.size());
+        auto task = [&table, group, &group_keys = keys.at(i), &attr, begin,
+                     end]() {
+          for (size_t j = begin; j < end; ++j)
+            group_keys[j] = attr(table, group[j]);
+        };
+        if (pool == nullptr)
+          task();
+        else
+          pool->submit(task);
       }
     }
-  }
-};
+    if (pool != nullptr)
+      pool->wait();
 
-template <class Attr> class NonHashableFilter : public Filter<Attr> {
-public:
-  // TODO: Consider making the the strings as FilePtr
-  NonHashableFilter(const FileSets &_file_sets, Attr _attr)
-      : Filter<Attr>{_file_sets, _attr} {
-    for (const FileVector &files : _file_sets) {
-      std::list<FilePtr> file_list(files.begin(), files.end());
-
-      while (!file_list.empty()) {
-        FileVector file_vector{file_list.front()};
-        FilePtr top = file_vector.at(0);
-        file_list.erase(file_list.begin());
-        for (auto it = file_list.begin(); it != file_list.end();) {
-          if (_attr(top->get_path(), (*it)->get_path())) {
-            file_vector.emplace_back(*it);
-            it = file_list.erase(it);
-          } else
-            ++it;
-        }
-        if (file_vector.size() > 1)
-          Filter<Attr>::new_file_sets.emplace_back(file_vector);
-      }
+    std::vector<uint32_t> class_of;
+    for (size_t i = 0; i < groups.size(); ++i) {
+      FlatIndexMap<ReturnType> index{groups[i].size()};
+      class_of.clear();
+      for (const auto &key : keys.at(i))
+        class_of.push_back(index.insert(key).first);
+      add_classes(groups[i], class_of, index.size(), new_groups);
     }
   }
 
+  IndexGroups new_groups;
+
 private:
+  static constexpr size_t grain = 64;
 };
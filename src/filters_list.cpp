@@ -21,136 +21,439 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "filters_list.h"
 
 #include <fmt/format.h>
-#include <stdint.h> // for uint64_t
-#include <stdlib.h> // for free, malloc
-#include <xxhash.h> // for XXH_INLINE_XXH3_128bits_digest
+#include <stdint.h>   // for uint64_t
+#include <xxhash.h>   // for XXH_INLINE_XXH3_128bits_digest
 
+#include <algorithm>  // for all_of, sort
 #include <exception>  // for exception
 #include <filesystem> // for file_size, directory_entry
 #include <fstream>
 #include <iostream> // for operator<<, basic_ostream, cout
+#include <map>          // for map
+#include <optional>     // for optional
 #include <unordered_set>
 
-#include "debug.h"  // for error, format, vformat_to, format...
-#include "filter.h" // for FilePtr
+#include "async_reader.h"   // for AsyncReader
+#include "debug.h"          // for error, format, vformat_to, format...
+#include "device_profile.h" // for DeviceProfile, DeviceProfiles
+#include "flat_index_map.h" // for FlatIndexMap
+#include "hash_cache.h"     // for HashCache
+#include "io_stats.h"       // for IOStats
+#include "mmap_reader.h"    // for MmapReader
+#include "read_order.h"     // for ReadOrder
 
 namespace fs = std::filesystem;
 
+namespace {
+HashCache *hash_cache{nullptr};
+size_t read_queue_depth{1};
+constexpr size_t read_block_size = 64 * (1 << 10);
+uint64_t mmap_threshold{64 * (1 << 20)};
+
 /**
- * @brief Convert the hash returned by xxhash to a string same as what is
- * returned by the command `xxh128sum a.txt`. This is what is recommended by
- * the xxhash repository.
- * //
- * https://github.com/Cyan4973/xxHash/blob/805c00b68fa754200ada0c207ffeaa7a4409377c/cli/xxhsum.c#L243
+ * @brief Look the digest of a prefix of a file up in the hash cache by its
+ * key.
  *
- * @param hash The XXH128_hash_t object returned by xxhash algorithm.
- * @param str The string to write the hash to.
+ * @param key The key of the file.
+ * @param length The length of the prefix.
+ * @param hash Set to the digest on a hit.
+ *
+ * @return true on a hit and false otherwise.
  */
-void convert_xxh128_hash_to_string(XXH128_hash_t hash, std::string &str) {
-  std::ostringstream os;
-  XXH128_canonical_t cano;
-  XXH128_canonicalFromHash(&cano, hash);
-  for (size_t i = 0; i < sizeof(cano.digest); ++i) {
-    os << std::setw(2) << std::setfill('0') << std::hex << int(cano.digest[i]);
-  }
-  str = os.str();
+bool cache_lookup(const std::optional<HashCache::Key> &key, uint64_t length,
+                  Hash128 &hash) {
+  if (hash_cache == nullptr || !key)
+    return false;
+  std::optional<HashCache::Digest> digest = hash_cache->lookup(*key, length);
+  IOStats::count_cache_lookup(digest.has_value());
+  if (!digest)
+    return false;
+  hash.low64 = digest->low64;
+  hash.high64 = digest->high64;
+  return true;
+}
+
+void cache_store(const std::optional<HashCache::Key> &key, uint64_t length,
+                 const Hash128 &hash) {
+  if (hash_cache != nullptr && key)
+    hash_cache->store(*key, length,
+                      HashCache::Digest{hash.low64, hash.high64});
+}
+
+Hash128 digest(XXH3_state_t &state) {
+  XXH128_hash_t hash = XXH3_128bits_digest(&state);
+  return Hash128{hash.low64, hash.high64};
 }
 
 /**
- * @brief Get the size of the file pointed to by the FilePtr.
+ * @brief The reader of the calling thread.  Every thread gets its own since an
+ * io_uring instance must not be shared between threads, and one for every
+ * queue depth and block size the devices it reads from want.
  *
- * @param a The FilePtr object to calculate hash
+ * @param device The profile of the device to read from, nullptr for the
+ * --queue-depth setting and the default block size.
+ */
+AsyncReader &thread_reader(const DeviceProfile *device = nullptr) {
+  thread_local std::map<std::pair<size_t, size_t>,
+                        std::unique_ptr<AsyncReader>>
+      readers;
+  size_t depth = read_queue_depth, block_size = read_block_size;
+  if (device != nullptr) {
+    if (device->queue_depth != 0)
+      depth = device->queue_depth;
+    block_size = device->block_size;
+  }
+  std::unique_ptr<AsyncReader> &reader = readers[{depth, block_size}];
+  if (reader == nullptr)
+    reader = AsyncReader::create(depth, block_size);
+  return *reader;
+}
+
+// The prefixes hashed by xxhash_progressive grow by this factor every round.
+constexpr uint64_t first_prefix_size = HashCache::head_size;
+constexpr uint64_t prefix_growth = 16;
+
+/**
+ * @brief How far xxhash_progressive got with a file.
+ */
+struct Prefix {
+  XXH3_state_t state;
+  // The bytes hashed into the state.
+  uint64_t offset{0};
+  uint64_t size{0};
+  bool ok{false};
+  std::optional<HashCache::Key> key;
+  // The digest of the first round, when it was hashed ahead of time.
+  std::optional<Hash128> head;
+  // The length of the prefix compared in the current round, and its digest
+  // when it was not read but taken from `head` or the hash cache.  The state
+  // then stays where it is, a later round reads on from its offset.
+  uint64_t length{0};
+  std::optional<Hash128> known;
+  // Files are read in increasing rank.
+  size_t rank{0};
+  // The device the file is on, nullptr when it is not known.
+  const DeviceProfile *device{nullptr};
+
+  // The offset the prefix ends at in a round reading up to `limit`.
+  uint64_t end(uint64_t limit) const {
+    return limit == 0 ? size : std::min(limit, size);
+  }
+  bool complete() const { return length >= size; }
+  Hash128 key_digest() { return known ? *known : digest(state); }
+};
+
+/**
+ * @brief Hash a window of a mapped file into a Prefix, the MmapReader callback
+ * of extend_prefixes.
+ */
+void hash_mapped(void *context, const unsigned char *data, size_t size) {
+  Prefix &prefix = *static_cast<Prefix *>(context);
+  (void)XXH3_128bits_update(&prefix.state, data, size);
+  prefix.offset += size;
+}
+
+/**
+ * @brief Extend the hashed prefixes of the files up to `limit` bytes, going on
+ * from where the previous round stopped.  Files which cannot be read, or turn
+ * out shorter than they were, are marked as not ok.
  *
- * @return The size of the file.
+ * @param paths The paths of all the files.
+ * @param prefixes The progress of all the files.
+ * @param indices The files to extend.
+ * @param limit The length of the prefixes, 0 for the whole files.
  */
-size_t FiltersList::file_size(const FilePtr a) {
-  size_t size_a = fs::file_size((a->get_resolved_dir_entry()).path());
-  return size_a;
+void extend_prefixes(const std::vector<std::string> &paths,
+                     std::vector<Prefix> &prefixes,
+                     const std::vector<size_t> &indices, uint64_t limit) {
+  std::vector<size_t> to_read;
+  std::vector<std::string> read_paths;
+  std::vector<uint64_t> offsets;
+  for (size_t i : indices) {
+    Prefix &prefix = prefixes.at(i);
+    uint64_t end = prefix.end(limit);
+    if (!prefix.ok || prefix.offset >= end)
+      continue;
+    if (mmap_threshold != 0 && end - prefix.offset >= mmap_threshold) {
+      prefix.ok = MmapReader::read_range(paths.at(i), prefix.offset, end,
+                                         hash_mapped, &prefix);
+      continue;
+    }
+    to_read.push_back(i);
+    read_paths.push_back(paths.at(i));
+    offsets.push_back(prefix.offset);
+  }
+
+  // The files of each kind of device are read together, by the reader suited
+  // to it.
+  auto same_reader = [](const DeviceProfile *a, const DeviceProfile *b) {
+    if (a == nullptr || b == nullptr)
+      return a == b;
+    return a->queue_depth == b->queue_depth && a->block_size == b->block_size;
+  };
+  std::vector<bool> taken(to_read.size(), false), ok;
+  std::vector<size_t> batch;
+  std::vector<std::string> batch_paths;
+  std::vector<uint64_t> batch_offsets;
+  for (size_t j = 0; j < to_read.size(); ++j) {
+    if (taken.at(j))
+      continue;
+    const DeviceProfile *device = prefixes.at(to_read.at(j)).device;
+    batch.clear();
+    batch_paths.clear();
+    batch_offsets.clear();
+    for (size_t k = j; k < to_read.size(); ++k) {
+      if (taken.at(k) ||
+          !same_reader(device, prefixes.at(to_read.at(k)).device))
+        continue;
+      taken.at(k) = true;
+      batch.push_back(to_read.at(k));
+      batch_paths.push_back(std::move(read_paths.at(k)));
+      batch_offsets.push_back(offsets.at(k));
+    }
+    thread_reader(device).read_ranges(
+        batch_paths, batch_offsets, limit,
+        [&prefixes, &batch](size_t index, const unsigned char *data,
+                            size_t size) {
+          Prefix &prefix = prefixes.at(batch.at(index));
+          (void)XXH3_128bits_update(&prefix.state, data, size);
+          prefix.offset += size;
+        },
+        ok);
+    for (size_t b = 0; b < batch.size(); ++b)
+      prefixes.at(batch.at(b)).ok = ok.at(b);
+  }
+
+  for (size_t i : indices) {
+    Prefix &prefix = prefixes.at(i);
+    if (prefix.ok && prefix.offset < prefix.end(limit)) {
+      spdlog::warn("File changed while hashing, skipping: {}", paths.at(i));
+      prefix.ok = false;
+    }
+  }
 }
 
 /**
- * @brief Calculate the hash of the first 4KB of file.  This helps us speed up.
- * JDupes does something similar.  Instead of calcualting the hash of the whole
- * we just calculate the hash of the first 4KB.
+ * @brief Split a class of files by a key, dropping the files which are not ok
+ * and the classes left with one file.
  *
- * @param file The FilePtr object
+ * @param indices The class to split.
+ * @param prefixes The progress of all the files.
+ * @param key_of Returns the key of a file.
  *
- * @return The xxhash calculated for the first 4KB of the file.
+ * @return The classes, in the order of their first file.
  */
-std::string FiltersList::xxhash_4KB(const FilePtr file) {
-  XXH3_state_t state3;
-  XXH128_hash_t hash;
-  FILE *fptr = fopen(file->get_path().c_str(), "rb");
-
-  if (fptr == NULL)
-    throw std::runtime_error(
-        fmt::format("Cannot open file: {}", file->get_path()));
-
-  size_t read_size, block_size = 4 * (1 << 10);
-  void *const buffer = malloc(block_size);
-  XXH3_128bits_reset(&state3);
-
-  read_size = fread(buffer, 1, block_size, fptr);
-  if (read_size != block_size && ferror(fptr)) {
-    free(buffer);
-    fclose(fptr);
-    throw std::runtime_error(
-        fmt::format("Error reading file: {}", file->get_path()));
+template <class KeyOf>
+FileClasses split_class(const std::vector<size_t> &indices,
+                        const std::vector<Prefix> &prefixes, KeyOf key_of) {
+  FlatIndexMap<Hash128> index{indices.size()};
+  FileClasses classes;
+  for (size_t i : indices) {
+    if (!prefixes.at(i).ok)
+      continue;
+    auto [c, inserted] = index.insert(key_of(i));
+    if (inserted)
+      classes.emplace_back();
+    classes.at(c).push_back(i);
   }
+  std::erase_if(classes, [](const auto &c) { return c.size() < 2; });
+  return classes;
+}
+} // namespace
 
-  (void)XXH3_128bits_update(&state3, buffer, read_size);
-  hash = XXH3_128bits_digest(&state3);
-  fclose(fptr);
-  free(buffer);
+/**
+ * @brief Set the cache consulted by xxhash_progressive.
+ *
+ * @param cache The cache, nullptr to disable caching.
+ */
+void FiltersList::set_hash_cache(HashCache *cache) { hash_cache = cache; }
 
-  // https://github.com/Cyan4973/xxHash/blob/805c00b68fa754200ada0c207ffeaa7a4409377c/xxhash.h#L215
-  std::string hash_str;
-  convert_xxh128_hash_to_string(hash, hash_str);
-  return hash_str;
+/**
+ * @brief Set the number of reads the batch hashing functions keep in flight.
+ * Above 1 they read through io_uring when the kernel allows it.  Must be set
+ * before the hashing starts.
+ *
+ * @param queue_depth The number of reads in flight.
+ */
+void FiltersList::set_read_queue_depth(size_t queue_depth) {
+  read_queue_depth = queue_depth == 0 ? 1 : queue_depth;
 }
 
 /**
- * @brief Calculate the xxhash for the file.
+ * @brief Set the size from which files are hashed through a mapping rather
+ * than read into a buffer.
  *
- * @param file The FilePtr object to get the hash for.
+ * @param threshold The size in bytes, 0 to never map files.
+ */
+void FiltersList::set_mmap_threshold(uint64_t threshold) {
+  mmap_threshold = threshold;
+}
+
+/**
+ * @brief Convert the hash to a string same as what is returned by the command
+ * `xxh128sum a.txt`, i.e. the canonical (big endian) form in hex.
+ * //
+ * https://github.com/Cyan4973/xxHash/blob/805c00b68fa754200ada0c207ffeaa7a4409377c/cli/xxhsum.c#L243
+ *
+ * @param hash The hash.
  *
- * @return The 128 byte XXHash for the file.
+ * @return The hash in hex.
  */
-std::string FiltersList::xxhash(const FilePtr file) {
-  constexpr size_t block_size = 64 * (1 << 10);
-  void *const buffer = malloc(block_size);
-  try {
-    XXH128_hash_t hash;
-    // size_t total_size_bytes{0};
-    std::string path_str = file->get_path();
-    const char *path = path_str.c_str();
-    FILE *fptr = fopen(path, "rb");
-    if (fptr == nullptr) {
-      spdlog::error("XXHash: Ignoring file: {}", path_str);
-      free(buffer);
-      return std::string{};
-    }
+std::string FiltersList::to_hex(const Hash128 &hash) {
+  return fmt::format("{:016x}{:016x}", hash.high64, hash.low64);
+}
+
+std::ostream &operator<<(std::ostream &os, const Hash128 &hash) {
+  return os << FiltersList::to_hex(hash);
+}
+
+namespace {
+/**
+ * @brief The rounds of xxhash_progressive.
+ *
+ * @param paths The paths of the files.
+ * @param prefixes The files, with their size and cache key set and ok for the
+ * files to hash.
+ * @param digests Set to the full hash of the files in the returned classes.
+ *
+ * @return The classes of at least two files with equal hashes, ordered by
+ * their first index.
+ */
+FileClasses progressive_classes(const std::vector<std::string> &paths,
+                                std::vector<Prefix> &prefixes,
+                                std::vector<Hash128> &digests) {
+  std::vector<size_t> all;
+  for (size_t i = 0; i < prefixes.size(); ++i) {
+    if (!prefixes.at(i).ok)
+      continue;
+    XXH3_128bits_reset(&prefixes.at(i).state);
+    all.push_back(i);
+  }
+  digests.resize(paths.size());
 
-    XXH3_state_t state3;
-    XXH3_128bits_reset(&state3);
+  FileClasses pending{all}, done;
+  for (uint64_t limit = first_prefix_size; !pending.empty();
+       limit = limit > UINT64_MAX / prefix_growth ? 0 : limit * prefix_growth) {
+    // The prefix of every file is taken from its head or the hash cache, and
+    // only read if it is in neither.
+    std::vector<size_t> indices, to_extend;
+    for (const auto &c : pending)
+      indices.insert(indices.end(), c.begin(), c.end());
+    for (size_t i : indices) {
+      Prefix &prefix = prefixes.at(i);
+      prefix.length = prefix.end(limit);
+      prefix.known.reset();
+      Hash128 hash;
+      if (limit == first_prefix_size && prefix.head) {
+        prefix.known = prefix.head;
+        cache_store(prefix.key, prefix.length, *prefix.head);
+      } else if (prefix.offset < prefix.length &&
+                 cache_lookup(prefix.key, prefix.length, hash))
+        prefix.known = hash;
+      else if (prefix.offset < prefix.length)
+        to_extend.push_back(i);
+    }
+    std::stable_sort(to_extend.begin(), to_extend.end(),
+                     [&prefixes](size_t a, size_t b) {
+                       return prefixes.at(a).rank < prefixes.at(b).rank;
+                     });
+    extend_prefixes(paths, prefixes, to_extend, limit);
+    // Every prefix compared is remembered, so a file which drops out in this
+    // round is not read again on the next run.
+    for (size_t i : to_extend)
+      if (prefixes.at(i).ok)
+        cache_store(prefixes.at(i).key, prefixes.at(i).length,
+                    prefixes.at(i).key_digest());
 
-    size_t read_size;
-    while ((read_size = fread(buffer, 1, block_size, fptr)) > 0) {
-      (void)XXH3_128bits_update(&state3, buffer, read_size);
-      // total_size_bytes += read_size;
+    FileClasses next;
+    for (const auto &c : pending) {
+      for (auto &split : split_class(c, prefixes, [&prefixes](size_t i) {
+             return prefixes.at(i).key_digest();
+           })) {
+        bool complete = std::all_of(split.begin(), split.end(), [&](size_t i) {
+          return prefixes.at(i).complete();
+        });
+        if (!complete) {
+          next.emplace_back(std::move(split));
+          continue;
+        }
+        for (size_t i : split)
+          digests.at(i) = prefixes.at(i).key_digest();
+        done.emplace_back(std::move(split));
+      }
     }
+    pending = std::move(next);
+  }
+  std::sort(done.begin(), done.end(),
+            [](const auto &a, const auto &b) { return a.front() < b.front(); });
+  return done;
+}
+} // namespace
 
-    hash = XXH3_128bits_digest(&state3);
-    fclose(fptr);
-    free(buffer);
-
-    // https://github.com/Cyan4973/xxHash/blob/805c00b68fa754200ada0c207ffeaa7a4409377c/xxhash.h#L215
-    std::string hash_str;
-    convert_xxh128_hash_to_string(hash, hash_str);
-    return hash_str;
-  } catch (const std::exception &exp) {
-    std::cout << "Caught exception: '" << exp.what() << "'\n";
-    free(buffer);
-    throw exp;
+/**
+ * @brief xxhash_progressive over a group of a FileTable.  The full hashes of
+ * the files in the classes are kept in the table, and the head digests found
+ * in it stand in for the first round.  If the table has read keys, the files
+ * are read in ReadOrder.  The files are read with the queue depth and block
+ * size of the device they are on.
+ *
+ * @param table The files.
+ * @param group The indices of the files to split.
+ *
+ * @return The classes, as indices into group, ordered by their first index.
+ */
+FileClasses
+FiltersList::xxhash_progressive(FileTable &table,
+                                std::span<const FileTable::Index> group) {
+  std::vector<std::string> paths;
+  std::vector<Prefix> prefixes(group.size());
+  std::vector<size_t> ranks;
+  if (table.has_read_keys())
+    ranks = ReadOrder::ranks(table, group);
+  for (size_t i = 0; i < group.size(); ++i) {
+    FileTable::Index f = group[i];
+    if (!ranks.empty())
+      prefixes.at(i).rank = ranks.at(i);
+    paths.emplace_back(table.path(f));
+    prefixes.at(i).size = table.file_size(f);
+    prefixes.at(i).key = HashCache::key_for(table, f);
+    prefixes.at(i).device =
+        &DeviceProfiles::get(table.dev(f), paths.at(i).c_str());
+    if (table.has_head(f))
+      prefixes.at(i).head = table.head(f);
+    prefixes.at(i).ok = true;
   }
+  std::vector<Hash128> digests;
+  FileClasses classes = progressive_classes(paths, prefixes, digests);
+  for (const auto &c : classes)
+    for (size_t i : c)
+      table.set_digest(group[i], digests.at(i));
+  return classes;
+}
+
+/**
+ * @brief Hash the first 4KB of files, the first round of xxhash_progressive,
+ * through the reader of the calling thread.
+ *
+ * @param paths The files.
+ *
+ * @return The digests, nothing for the files which could not be read.
+ */
+FiltersList::HashVector
+FiltersList::xxhash_heads(const std::vector<std::string> &paths) {
+  std::vector<XXH3_state_t> states(paths.size());
+  for (auto &state : states)
+    XXH3_128bits_reset(&state);
+  std::vector<bool> ok;
+  thread_reader().read_files(
+      paths, first_prefix_size,
+      [&states](size_t index, const unsigned char *data, size_t size) {
+        (void)XXH3_128bits_update(&states.at(index), data, size);
+      },
+      ok);
+  HashVector result(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i)
+    if (ok.at(i))
+      result.at(i) = digest(states.at(i));
+  return result;
 }
@@ -18,19 +18,51 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // SPDX-License-Identifier: AGPL-3.0
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
 #pragma once
-#include <stdio.h> // for size_t
+#include <stdint.h> // for uint64_t
+#include <stdio.h>  // for size_t
 
 #include <filesystem> // for filesystem
+#include <functional> // for hash
+#include <optional>   // for optional
+#include <ostream>    // for ostream
 #include <string>     // for string
+#include <vector>     // for vector
 
-#include "filter.h" // for FilePtr
+#include "bin_compare_files.h" // for FileClasses
+#include "file_table.h"        // for FileTable, Hash128
 
 namespace fs = std::filesystem;
 
+/**
+ * @brief The device and inode numbers of a file.  Hard links and the same file
+ * reached through bind mounts share them.
+ */
+struct DevIno {
+  uint64_t dev;
+  uint64_t ino;
+  bool operator==(const DevIno &other) const = default;
+};
+
+template <> struct std::hash<DevIno> {
+  size_t operator()(const DevIno &d) const noexcept {
+    return std::hash<uint64_t>{}(d.ino) ^ (std::hash<uint64_t>{}(d.dev) << 1);
+  }
+};
+
+std::ostream &operator<<(std::ostream &os, const Hash128 &hash);
+
+class HashCache;
+
 namespace FiltersList {
-size_t file_size(const FilePtr a);
-std::string xxhash(const FilePtr file);
-std::string xxhash_4KB(const FilePtr file);
+using HashVector = std::vector<std::optional<Hash128>>;
+
+void set_hash_cache(HashCache *cache);
+void set_read_queue_depth(size_t queue_depth);
+void set_mmap_threshold(uint64_t threshold);
+std::string to_hex(const Hash128 &hash);
+FileClasses xxhash_progressive(FileTable &table,
+                               std::span<const FileTable::Index> group);
+HashVector xxhash_heads(const std::vector<std::string> &paths);
 
 bool is_subdirectory(const std::filesystem::path &p1,
                      const std::filesystem::path &p2);
@@ -0,0 +1,128 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint32_t, uint64_t
+
+#include <functional> // for hash
+#include <optional>   // for optional
+#include <utility>    // for pair
+#include <vector>     // for vector
+
+/**
+ * @brief An insertion ordered set of keys, each given the index at which it
+ * was first inserted.  The keys are kept contiguously and looked up through
+ * an open addressing table with linear probing.  A slot holds the index of its
+ * key and a tag taken from the high bits of the hash, so probing rarely
+ * touches a key which does not match.
+ */
+template <class Key, class Hash = std::hash<Key>> class FlatIndexMap {
+public:
+  explicit FlatIndexMap(size_t expected_size = 0) {
+    keys.reserve(expected_size);
+    size_t capacity = 16;
+    while (capacity < 2 * expected_size)
+      capacity *= 2;
+    slots.assign(capacity, Slot{empty, 0});
+  }
+
+  /**
+   * @brief Find the key, adding it if it is not there yet.
+   *
+   * @param key The key to look up.
+   *
+   * @return The index of the key and whether it was inserted.
+   */
+  std::pair<uint32_t, bool> insert(const Key &key) {
+    uint64_t h = mix(Hash{}(key));
+    uint32_t tag = static_cast<uint32_t>(h >> 32);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      Slot &slot = slots[i];
+      if (slot.index == empty) {
+        if (2 * (keys.size() + 1) > slots.size()) {
+          grow();
+          return insert(key);
+        }
+        slot = Slot{static_cast<uint32_t>(keys.size()), tag};
+        keys.push_back(key);
+        return {slot.index, true};
+      }
+      if (slot.tag == tag && keys[slot.index] == key)
+        return {slot.index, false};
+    }
+  }
+
+  /**
+   * @brief Find the key without adding it.
+   *
+   * @param key The key to look up.
+   *
+   * @return The index of the key, nothing if it is not there.
+   */
+  std::optional<uint32_t> find(const Key &key) const {
+    uint64_t h = mix(Hash{}(key));
+    uint32_t tag = static_cast<uint32_t>(h >> 32);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      const Slot &slot = slots[i];
+      if (slot.index == empty)
+        return std::nullopt;
+      if (slot.tag == tag && keys[slot.index] == key)
+        return slot.index;
+    }
+  }
+
+  size_t size() const { return keys.size(); }
+  const Key &key(uint32_t index) const { return keys[index]; }
+
+private:
+  struct Slot {
+    uint32_t index;
+    uint32_t tag;
+  };
+  static constexpr uint32_t empty = UINT32_MAX;
+
+  std::vector<Key> keys;
+  std::vector<Slot> slots;
+
+  // Hashes such as std::hash<size_t> are the identity, spread their bits
+  // before they are masked (the finalizer of MurmurHash3).
+  static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  void grow() {
+    slots.assign(2 * slots.size(), Slot{empty, 0});
+    size_t mask = slots.size() - 1;
+    for (uint32_t index = 0; index < keys.size(); ++index) {
+      uint64_t h = mix(Hash{}(keys[index]));
+      size_t i = h & mask;
+      while (slots[i].index != empty)
+        i = (i + 1) & mask;
+      slots[i] = Slot{index, static_cast<uint32_t>(h >> 32)};
+    }
+  }
+};
@@ -0,0 +1,307 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#define XXH_PRIVATE_API 0
+#include "hash_cache.h"
+
+#include <fcntl.h>    // for open, O_RDONLY
+#include <stdio.h>    // for fopen, fwrite, rename
+#include <string.h>   // for memcmp, memcpy
+#include <sys/mman.h> // for mmap, munmap
+#include <sys/stat.h> // for fstat
+#include <unistd.h>   // for close, fsync, getpid
+#include <xxhash.h>   // for XXH3_64bits
+
+#include <algorithm> // for lower_bound, min, sort
+#include <tuple>     // for tie
+
+#include "debug.h" // for warn
+
+namespace {
+constexpr char magic[8] = {'U', 'N', 'D', 'U', 'P', 'E', 'S', 'C'};
+constexpr uint32_t version = 2;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count;
+  uint64_t checksum;
+};
+
+bool same_metadata(const HashCache::Key &a, const HashCache::Key &b) {
+  return a.dev == b.dev && a.ino == b.ino && a.size == b.size &&
+         a.mtime_ns == b.mtime_ns && a.ctime_ns == b.ctime_ns;
+}
+} // namespace
+
+/**
+ * @brief Open the cache file, if there is one.
+ *
+ * @param _path The path of the cache file.
+ */
+HashCache::HashCache(const std::string &_path) : path{_path} {
+  static_assert(sizeof(Record) == 64, "The on-disk record layout changed.");
+  load();
+}
+
+HashCache::~HashCache() { unmap(); }
+
+/**
+ * @brief Get the key of a file from the metadata read when it was found.
+ *
+ * @param file_stat The metadata of the file.
+ */
+HashCache::Key HashCache::key_for(const FileStat &file_stat) {
+  return Key{file_stat.dev, file_stat.ino, file_stat.size, file_stat.mtime_ns,
+             file_stat.ctime_ns};
+}
+
+/**
+ * @brief Get the key of a file of a FileTable.
+ *
+ * @param table The files.
+ * @param i The index of the file.
+ */
+HashCache::Key HashCache::key_for(const FileTable &table, FileTable::Index i) {
+  return Key{table.dev(i), table.ino(i), table.file_size(i), table.mtime_ns(i),
+             table.ctime_ns(i)};
+}
+
+/**
+ * @brief Map the cache file and validate it.  A missing file is an empty
+ * cache, a corrupt one is logged and treated as empty, it is replaced on the
+ * next save().
+ */
+void HashCache::load() {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    spdlog::warn("Hash cache is corrupt, rebuilding it: {}", path);
+    return;
+  }
+
+  mapping_size = static_cast<size_t>(st.st_size);
+  mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    mapping_size = 0;
+    spdlog::warn("Cannot map hash cache, ignoring it: {}", path);
+    return;
+  }
+
+  Header header;
+  memcpy(&header, mapping, sizeof(header));
+  const Record *begin = reinterpret_cast<const Record *>(
+      static_cast<const char *>(mapping) + sizeof(Header));
+  size_t body_size = mapping_size - sizeof(Header);
+  if (memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+      header.version != version) {
+    unmap();
+    spdlog::info("Hash cache is from another version, rebuilding it: {}",
+                 path);
+    return;
+  }
+  if (memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.record_size != sizeof(Record) ||
+      body_size % sizeof(Record) != 0 ||
+      header.count != body_size / sizeof(Record) ||
+      XXH3_64bits(begin, body_size) != header.checksum) {
+    unmap();
+    spdlog::warn("Hash cache is corrupt, rebuilding it: {}", path);
+    return;
+  }
+  records = begin;
+  num_records = header.count;
+}
+
+void HashCache::unmap() {
+  if (mapping != nullptr)
+    munmap(mapping, mapping_size);
+  mapping = nullptr;
+  mapping_size = 0;
+  records = nullptr;
+  num_records = 0;
+}
+
+/**
+ * @brief Binary search the mapped records.
+ *
+ * @param dev_ino The device and inode to look for.
+ *
+ * @return The records of the file, by length, an empty range if there are
+ * none.
+ */
+std::pair<const HashCache::Record *, const HashCache::Record *>
+HashCache::find(const DevIno &dev_ino) const {
+  const Record *end = records + num_records;
+  const Record *first = std::lower_bound(
+      records, end, dev_ino, [](const Record &r, const DevIno &d) {
+        return std::tie(r.key.dev, r.key.ino) < std::tie(d.dev, d.ino);
+      });
+  const Record *last = first;
+  while (last != end && last->key.dev == dev_ino.dev &&
+         last->key.ino == dev_ino.ino)
+    ++last;
+  return {first, last};
+}
+
+/**
+ * @brief The prefix length a kind of digest covers.
+ */
+uint64_t HashCache::length_of(const Key &key, Kind kind) {
+  return kind == Kind::head ? std::min(head_size, key.size) : key.size;
+}
+
+/**
+ * @brief Look up the head or the full digest.
+ */
+std::optional<HashCache::Digest> HashCache::lookup(const Key &key, Kind kind) {
+  return lookup(key, length_of(key, kind));
+}
+
+/**
+ * @brief Look up the digest of a prefix.  The records of a file whose
+ * metadata does not match the key are marked stale.
+ *
+ * @param key The current metadata of the file.
+ * @param length The length of the prefix, the size of the file for the full
+ * digest.
+ *
+ * @return The digest, or nothing on a miss.
+ */
+std::optional<HashCache::Digest> HashCache::lookup(const Key &key,
+                                                   uint64_t length) {
+  DevIno dev_ino{key.dev, key.ino};
+  const std::lock_guard<std::mutex> lock(mutex);
+  std::optional<Digest> digest;
+  if (auto it = updates.find(dev_ino); it != updates.end()) {
+    if (same_metadata(it->second.key, key))
+      for (const auto &[l, d] : it->second.digests)
+        if (l == length)
+          digest = d;
+  } else if (!stale.contains(dev_ino)) {
+    auto [first, last] = find(dev_ino);
+    if (first != last && !same_metadata(first->key, key))
+      stale.insert(dev_ino);
+    else
+      for (const Record *r = first; r != last; ++r)
+        if (r->length == length)
+          digest = r->digest;
+  }
+  if (!digest) {
+    ++num_misses;
+    return std::nullopt;
+  }
+  ++num_hits;
+  return digest;
+}
+
+/**
+ * @brief Remember the head or the full digest.
+ */
+void HashCache::store(const Key &key, Kind kind, const Digest &digest) {
+  store(key, length_of(key, kind), digest);
+}
+
+/**
+ * @brief Remember the digest of a prefix, it is written out by save().
+ *
+ * @param key The metadata of the file, taken before it was read.
+ * @param length The length of the prefix, the size of the file for the full
+ * digest.
+ * @param digest The digest.
+ */
+void HashCache::store(const Key &key, uint64_t length, const Digest &digest) {
+  DevIno dev_ino{key.dev, key.ino};
+  const std::lock_guard<std::mutex> lock(mutex);
+  auto [it, inserted] = updates.try_emplace(dev_ino);
+  Entry &entry = it->second;
+  if (inserted) {
+    entry.key = key;
+    if (!stale.contains(dev_ino)) {
+      auto [first, last] = find(dev_ino);
+      if (first != last && same_metadata(first->key, key))
+        for (const Record *r = first; r != last; ++r)
+          entry.digests.emplace_back(r->length, r->digest);
+    }
+  } else if (!same_metadata(entry.key, key)) {
+    entry = Entry{key, {}};
+  }
+
+  for (auto &[l, d] : entry.digests)
+    if (l == length) {
+      d = digest;
+      return;
+    }
+  entry.digests.emplace_back(length, digest);
+}
+
+/**
+ * @brief Write the cache: the mapped records that are still valid merged with
+ * the new ones.  The file is written under a temporary name and renamed over
+ * the old one.
+ */
+void HashCache::save() {
+  std::vector<Record> merged;
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    merged.reserve(num_records + updates.size());
+    for (size_t i = 0; i < num_records; ++i) {
+      DevIno dev_ino{records[i].key.dev, records[i].key.ino};
+      if (!stale.contains(dev_ino) && !updates.contains(dev_ino))
+        merged.push_back(records[i]);
+    }
+    for (const auto &[dev_ino, entry] : updates)
+      for (const auto &[length, digest] : entry.digests)
+        merged.push_back(Record{entry.key, length, digest});
+  }
+  std::sort(merged.begin(), merged.end(), [](const Record &a, const Record &b) {
+    return std::tie(a.key.dev, a.key.ino, a.length) <
+           std::tie(b.key.dev, b.key.ino, b.length);
+  });
+
+  Header header{};
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.record_size = sizeof(Record);
+  header.count = merged.size();
+  header.checksum = XXH3_64bits(merged.data(), merged.size() * sizeof(Record));
+
+  std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+  FILE *fptr = fopen(tmp_path.c_str(), "wb");
+  if (fptr == nullptr) {
+    spdlog::warn("Cannot write hash cache: {}", tmp_path);
+    return;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fptr) == 1 &&
+            fwrite(merged.data(), sizeof(Record), merged.size(), fptr) ==
+                merged.size() &&
+            fflush(fptr) == 0 && fsync(fileno(fptr)) == 0;
+  ok = fclose(fptr) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    spdlog::warn("Cannot write hash cache: {}", path);
+    unlink(tmp_path.c_str());
+  }
+}
@@ -0,0 +1,119 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <atomic>        // for atomic
+#include <mutex>         // for mutex
+#include <optional>      // for optional
+#include <string>        // for string
+#include <unordered_map> // for unordered_map
+#include <unordered_set> // for unordered_set
+#include <utility>       // for pair
+#include <vector>        // for vector
+
+#include "file.h"         // for FileStat
+#include "file_table.h"   // for FileTable
+#include "filters_list.h" // for DevIno
+
+/**
+ * @brief A persistent cache of file digests: the head (first 4KB), the full
+ * digest and the digests of the prefixes xxhash_progressive compares.
+ *
+ * The cache file is a fixed header followed by one record per digest, sorted
+ * by device, inode and prefix length, so it can be memory mapped and searched
+ * in place.  A record is only trusted while the size, mtime and ctime of the
+ * file are the same as when it was written; records found stale are dropped
+ * on save().
+ *
+ * save() writes a new file next to the old one and renames it into place, so
+ * concurrent readers always see a complete table.  A file that fails the
+ * header or checksum validation is ignored and rebuilt.
+ */
+class HashCache {
+public:
+  struct Digest {
+    uint64_t low64;
+    uint64_t high64;
+  };
+
+  /**
+   * @brief The stat metadata a record is keyed and validated on.
+   */
+  struct Key {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+  };
+
+  enum class Kind { head, full };
+  // The length of the prefix a head digest covers.
+  static constexpr uint64_t head_size = 4 * (1 << 10);
+
+  explicit HashCache(const std::string &path);
+  ~HashCache();
+  HashCache(const HashCache &) = delete;
+  HashCache &operator=(const HashCache &) = delete;
+
+  static Key key_for(const FileStat &file_stat);
+  static Key key_for(const FileTable &table, FileTable::Index i);
+
+  std::optional<Digest> lookup(const Key &key, Kind kind);
+  std::optional<Digest> lookup(const Key &key, uint64_t length);
+  void store(const Key &key, Kind kind, const Digest &digest);
+  void store(const Key &key, uint64_t length, const Digest &digest);
+  void save();
+
+  size_t size() const { return num_records; }
+  size_t hits() const { return num_hits; }
+  size_t misses() const { return num_misses; }
+
+private:
+  struct Record {
+    Key key;
+    uint64_t length;
+    Digest digest;
+  };
+
+  // The digests of a file stored since the cache was loaded, by length.
+  struct Entry {
+    Key key;
+    std::vector<std::pair<uint64_t, Digest>> digests;
+  };
+
+  std::string path;
+  void *mapping{nullptr};
+  size_t mapping_size{0};
+  const Record *records{nullptr};
+  size_t num_records{0};
+
+  std::mutex mutex;
+  std::unordered_map<DevIno, Entry> updates;
+  std::unordered_set<DevIno> stale;
+  std::atomic<size_t> num_hits{0}, num_misses{0};
+
+  void load();
+  void unmap();
+  std::pair<const Record *, const Record *> find(const DevIno &dev_ino) const;
+  static uint64_t length_of(const Key &key, Kind kind);
+};
@@ -19,36 +19,43 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
 #include "io.h"
 
+#include <fcntl.h>  // for AT_FDCWD
+#include <stdint.h> // for SIZE_MAX
 #include <unistd.h>
 
 #include <algorithm>  // for sort
+#include <atomic>     // for atomic
 #include <cassert>    // for assert
 #include <cctype>     // for isprint
 #include <chrono>     // for milliseconds
+#include <exception>  // for exception_ptr, current_exception
 #include <filesystem> // for directory_entry
 #include <fstream>
-#include <iostream>          // for operator<<, basic_ostream, basic_is...
-#include <locale>            // for isspace, locale
-#include <map>               // for operator!=, operator==
-#include <memory>            // for shared_ptr, make_shared
-#include <mutex>             // for mutex
-#include <nlohmann/json.hpp> // for basic_json
-#include <numeric>           // for iota
-#include <regex>             // for regex_match, match_results, regex
-#include <sstream>           // for istringstream
-#include <sstream>           // for basic_istringstream
-#include <stdexcept>         // for runtime_error
-#include <string>            // for basic_string, char_traits, operator==
-#include <thread>            // for thread, sleep_for
+#include <iostream>  // for operator<<, basic_ostream, basic_is...
+#include <locale>    // for isspace, locale
+#include <map>       // for operator!=, operator==
+#include <memory>    // for shared_ptr, make_shared
+#include <mutex>     // for mutex
+#include <numeric>   // for iota
+#include <optional>  // for optional
+#include <regex>     // for regex_match, match_results, regex
+#include <sstream>   // for istringstream
+#include <sstream>   // for basic_istringstream
+#include <span>      // for span
+#include <stdexcept> // for runtime_error
+#include <string>    // for basic_string, char_traits, operator==
+#include <thread>    // for thread, sleep_for
 #include <utility>
 #include <vector> // for vector
 
+#include "bounded_queue.h" // for BoundedQueue
 #include "cli.h"
 #include "debug.h"
-#include "file.h"   // for File
-#include "filter.h" // for FileSets, FileVector
+#include "file.h"       // for File
+#include "file_table.h"       // for FileTable, IndexGroups
+#include "filter.h"           // for FileSets, FileVector
+#include "path_list_reader.h" // for PathListReader
 #include "fmt/core.h"
-#include "nlohmann/json_fwd.hpp" // for json
 #include "unistd.h"
 
 std::mutex animation_mutex;
@@ -56,7 +63,6 @@ bool processing_done{false};
 bool dry_run{false};
 size_t num_files;
 
-using json = nlohmann::json;
 std::shared_ptr<std::thread> animation_thread{};
 extern cxxopts::ParseResult cxxopts_results;
 
@@ -100,31 +106,179 @@ void IO::end_animation() {
   }
 }
 
+namespace {
 /**
- * @brief This function parses the initial file sets.
+ * @brief A run of consecutive input paths and, once a worker has been at
+ * them, their metadata.
+ */
+struct IngestBatch {
+  static constexpr size_t end = SIZE_MAX;
+  size_t seq{end};
+  PathListReader::Chunk chunk;
+  std::vector<FileType> file_types;
+  std::vector<std::optional<FileStat>> file_stats;
+  std::vector<bool> readable;
+};
+
+constexpr size_t ingest_batch_size = 1024;
+constexpr size_t ingest_queue_size = 64;
+
+void probe_batch(IngestBatch &batch) {
+  const auto &paths = batch.chunk.paths;
+  batch.file_types.resize(paths.size());
+  batch.file_stats.resize(paths.size());
+  batch.readable.resize(paths.size());
+  for (size_t j = 0; j < paths.size(); ++j) {
+    FileType file_type =
+        probe_path(paths.at(j).data(), batch.file_stats.at(j));
+    batch.file_types.at(j) = file_type;
+    if (file_type == FileType::regular_file ||
+        file_type == FileType::symlinked_file)
+      batch.readable.at(j) = is_readable(AT_FDCWD, paths.at(j).data());
+  }
+}
+
+/**
+ * @brief Add the accepted files of a probed batch to the table.
+ */
+void add_batch(const IngestBatch &batch, const std::set<FileType> &accepted,
+               FileTable &table, std::vector<FileTable::Index> &group,
+               EagerHasher *eager) {
+  const auto &paths = batch.chunk.paths;
+  for (size_t i = 0; i < paths.size(); ++i)
+    if (check_type_or_log(paths.at(i), batch.file_types.at(i),
+                          batch.file_stats.at(i), batch.readable.at(i),
+                          accepted)) {
+      group.push_back(table.add(paths.at(i), *batch.file_stats.at(i)));
+      if (eager != nullptr)
+        eager->added(group.back());
+    }
+}
+} // namespace
+
+/**
+ * @brief Read the NUL separated paths on stdin, or in files_from, into a
+ * FileTable.  Only the accepted and readable files go in the table, and all of
+ * them in one group.  The list is read in bulk by a PathListReader and the
+ * paths are stat'ed straight from its buffers.
+ *
+ * With a pool, a reader thread only splits the list into batches of paths,
+ * the workers of the pool stat and classify them, and the calling thread adds
+ * the batches to the table in input order.  The stages are connected by
+ * bounded queues, so no more than a few batches are in flight.  An exception
+ * in any stage stops them all and is rethrown here once they have stopped.
+ *
+ * With an EagerHasher, the files are handed to it as they are added, and half
+ * of the workers are left to it for hashing heads while the rest probe.
  *
- * @param initial_file_sets  The nested vector containing the sets of files
- * to be filtered.
+ * @param table The table to add the files to.
+ * @param initial_groups Gets the group of all the files added.
+ * @param pool The pool the paths are probed on, nullptr to probe them here.
+ * @param files_from The file holding the list, empty for stdin.  Throws a
+ * runtime_error if it cannot be opened.
+ * @param eager The EagerHasher told about the files added, if any.
+ * @param accepted The accepted FileTypes.
  */
-void IO::parse_input(FileSets &initial_file_sets,
-                     const std::set<FileType> &accepted) {
+void IO::parse_input(FileTable &table, IndexGroups &initial_groups,
+                     ThreadPool *pool, const std::string &files_from,
+                     EagerHasher *eager, const std::set<FileType> &accepted) {
+  PathListReader list{files_from};
   if (isatty(fileno(stdout)))
     animation_thread = std::make_shared<std::thread>([]() { IO::animation(); });
 
-  std::string line;
-  FileVector file_vector;
-  size_t file_index = 1;
-  while (std::getline(std::cin, line, '\0')) {
-    FilePtr f = std::make_shared<File>(File{line});
-    bool check_file = f->check_file_or_log(accepted);
-    if (check_file) {
-      f->index = file_index;
-      ++file_index;
-      file_vector.emplace_back(f);
+  std::vector<FileTable::Index> group;
+  if (pool == nullptr) {
+    IngestBatch batch;
+    while (list.next(batch.chunk, ingest_batch_size)) {
+      probe_batch(batch);
+      add_batch(batch, accepted, table, group, eager);
     }
+    initial_groups.add(group);
+    num_files = table.size();
+    return;
   }
-  initial_file_sets.emplace_back(file_vector);
-  num_files = initial_file_sets.at(0).size();
+
+  BoundedQueue<IngestBatch> to_probe{ingest_queue_size},
+      probed{ingest_queue_size};
+  size_t num_workers =
+      eager == nullptr ? pool->size() : std::max<size_t>(1, pool->size() / 2);
+  // The first exception of any stage.  After it every stage only passes its
+  // end markers on, so the others are not left waiting, and it is rethrown
+  // once they are all done.
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  std::atomic<bool> failed{false};
+  auto fail = [&error_mutex, &error, &failed]() {
+    const std::lock_guard<std::mutex> lock(error_mutex);
+    if (!error)
+      error = std::current_exception();
+    failed.store(true, std::memory_order_relaxed);
+  };
+
+  std::thread reader([&list, &to_probe, num_workers, &failed, &fail]() {
+    try {
+      IngestBatch batch;
+      for (size_t seq = 0; !failed.load(std::memory_order_relaxed) &&
+                           list.next(batch.chunk, ingest_batch_size);
+           ++seq) {
+        batch.seq = seq;
+        to_probe.push(std::move(batch));
+        batch = IngestBatch{};
+      }
+    } catch (...) {
+      fail();
+    }
+    for (size_t i = 0; i < num_workers; ++i)
+      to_probe.push(IngestBatch{});
+  });
+
+  for (size_t i = 0; i < num_workers; ++i)
+    pool->submit([&to_probe, &probed, &failed, &fail]() {
+      for (;;) {
+        IngestBatch batch = to_probe.pop();
+        if (batch.seq == IngestBatch::end) {
+          probed.push(std::move(batch));
+          return;
+        }
+        if (failed.load(std::memory_order_relaxed))
+          continue;
+        try {
+          probe_batch(batch);
+          probed.push(std::move(batch));
+        } catch (...) {
+          fail();
+        }
+      }
+    });
+
+  // The batches come back in any order, hold on to them until it is their
+  // turn.
+  std::map<size_t, IngestBatch> waiting;
+  size_t next_seq = 0;
+  for (size_t finished = 0; finished < num_workers;) {
+    IngestBatch batch = probed.pop();
+    if (batch.seq == IngestBatch::end) {
+      ++finished;
+      continue;
+    }
+    if (failed.load(std::memory_order_relaxed))
+      continue;
+    try {
+      waiting.emplace(batch.seq, std::move(batch));
+      for (auto it = waiting.begin();
+           it != waiting.end() && it->first == next_seq;
+           it = waiting.erase(it), ++next_seq)
+        add_batch(it->second, accepted, table, group, eager);
+    } catch (...) {
+      fail();
+    }
+  }
+  reader.join();
+  pool->wait();
+  if (error)
+    std::rethrow_exception(error);
+  initial_groups.add(group);
+  num_files = table.size();
 }
 
 /**
@@ -150,27 +304,35 @@ std::string IO::pprint_bytes(size_t bytes) {
 /**
  * @brief Prints the summary of the duplicates found.  Similar to f/j-dupes.
  *
- * @param resulting_file_sets The file sets after filtering.
+ * @param table The files.
+ * @param resulting_groups The groups after filtering.
+ * @param same_inode_groups The groups of paths sharing an inode.
  */
-void IO::print_summary(const FileSets &resulting_file_sets) {
-  size_t num_duplicate_files{}, num_sets{}, duplicates_size{};
-  num_sets = resulting_file_sets.size();
+void IO::print_summary(const FileTable &table,
+                       const IndexGroups &resulting_groups,
+                       const IndexGroups &same_inode_groups) {
+  if (!same_inode_groups.empty()) {
+    size_t num_links =
+        same_inode_groups.num_indices() - same_inode_groups.size();
+    std::cout << fmt::format("{} hard links (in {} sets), occupying no space",
+                             num_links, same_inode_groups.size())
+              << std::endl;
+  }
 
-  if (num_sets == 0) {
+  if (resulting_groups.empty()) {
     std::cout << "No duplicates found." << std::endl;
     return;
   }
 
-  for (const auto &files : resulting_file_sets) {
-    num_duplicate_files += files.size() - 1;
-    size_t file_size =
-        std::filesystem::file_size(files.at(0)->dir_entry.path());
-    duplicates_size += (files.size() - 1) * file_size;
+  size_t duplicates_size{};
+  for (size_t i = 0; i < resulting_groups.size(); ++i) {
+    std::span<const FileTable::Index> group = resulting_groups[i];
+    duplicates_size += (group.size() - 1) * table.file_size(group.front());
   }
-
-  std::cout << fmt::format("{} duplicate files (in {} sets), occupying {}",
-                           num_duplicate_files, num_sets,
-                           IO::pprint_bytes(duplicates_size))
+  std::cout << fmt::format(
+                   "{} duplicate files (in {} sets), occupying {}",
+                   resulting_groups.num_indices() - resulting_groups.size(),
+                   resulting_groups.size(), IO::pprint_bytes(duplicates_size))
             << std::endl;
 }
 
@@ -371,29 +533,3 @@ void IO::remove_file_io(const FileSets &file_sets, KeepFileSets &keep_file_sets,
   std::cout.rdbuf(cout_backup);
   of.close();
 }
-
-/**
- * @brief Print the json containing the set of file sets. This needs a mutex
- * because processing_done variable is shared with the animation thread.
- *
- * @param file_sets The vector of vectors to be printed in JSON format.
- */
-void IO::print_json(const FileSets &file_sets) {
-  nlohmann::json json_output;
-  for (const auto &file_vector : file_sets) {
-    std::vector<std::string> file_paths;
-    // TODO: See if the cppcheck is meaningful.
-    for (const auto &file : file_vector)
-      // cppcheck-suppress useStlAlgorithm
-      file_paths.emplace_back(file->dir_entry.path().string());
-
-    // We want to only take files which have duplicates.
-    if (file_paths.size() >= 2) {
-      json obj;
-      obj["file_list"] = file_paths;
-      json_output.emplace_back(obj);
-    }
-  }
-  // Dump json with an indentation of 4.
-  std::cout << json_output.dump(4) << std::endl;
-}
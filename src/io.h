@@ -25,13 +25,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string> // for string
 #include <vector> // for vector
 
-#include "filter.h" // for FileSets
+#include "eager_hasher.h" // for EagerHasher
+#include "file_table.h"   // for FileTable, IndexGroups
+#include "filter.h"       // for FileSets
+#include "thread_pool.h"  // for ThreadPool
 
 extern bool dry_run;
 namespace IO {
 void animation(size_t sleep_time_milliseconds);
 void end_animation();
-void parse_input(FileSets &initial_file_sets,
+void parse_input(FileTable &table, IndexGroups &initial_groups,
+                 ThreadPool *pool = nullptr, const std::string &files_from = "",
+                 EagerHasher *eager = nullptr,
                  const std::set<FileType> &accepted = {FileType::symlinked_file,
                                                        FileType::regular_file});
 
@@ -46,13 +51,13 @@ void show_file_list(const FileVector &orig_files,
 void get_matches(const std::regex &reg, const std::string &S,
                  std::vector<std::string> &result);
 
-void print_summary(const FileSets &resulting_file_sets);
+void print_summary(const FileTable &table, const IndexGroups &resulting_groups,
+                   const IndexGroups &same_inode_groups);
 void parse_file_list(std::string orig_string, std::vector<int> &file_list,
                      const int max_file_number);
 
 void sanitize_and_check_input(const std::string &str,
                               std::vector<bool> &keep_file_list);
-void print_json(const FileSets &file_sets);
 std::string pprint_bytes(size_t bytes);
 
 } // namespace IO
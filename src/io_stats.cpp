@@ -0,0 +1,100 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "io_stats.h"
+
+#include <atomic> // for atomic, memory_order_relaxed
+
+namespace {
+struct AtomicCounters {
+  std::atomic<uint64_t> opens{0}, reads{0}, bytes_read{0}, cache_hits{0},
+      cache_misses{0};
+};
+AtomicCounters counters[IOStats::num_phases];
+thread_local IOStats::Phase current_phase{IOStats::Phase::other};
+
+AtomicCounters &current() {
+  return counters[static_cast<size_t>(current_phase)];
+}
+} // namespace
+
+IOStats::Counters
+IOStats::Counters::operator-(const Counters &other) const {
+  return Counters{opens - other.opens, reads - other.reads,
+                  bytes_read - other.bytes_read, cache_hits - other.cache_hits,
+                  cache_misses - other.cache_misses};
+}
+
+IOStats::PhaseScope::PhaseScope(Phase phase) : previous(current_phase) {
+  current_phase = phase;
+}
+
+IOStats::PhaseScope::~PhaseScope() { current_phase = previous; }
+
+void IOStats::count_open() {
+  current().opens.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Count a read.
+ *
+ * @param bytes The number of bytes it returned.
+ */
+void IOStats::count_read(size_t bytes) {
+  current().reads.fetch_add(1, std::memory_order_relaxed);
+  current().bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Count a lookup in the hash cache.
+ *
+ * @param hit Whether the digest was found.
+ */
+void IOStats::count_cache_lookup(bool hit) {
+  (hit ? current().cache_hits : current().cache_misses)
+      .fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief The counts of a phase so far.
+ */
+IOStats::Counters IOStats::snapshot(Phase phase) {
+  const AtomicCounters &c = counters[static_cast<size_t>(phase)];
+  return Counters{c.opens.load(std::memory_order_relaxed),
+                  c.reads.load(std::memory_order_relaxed),
+                  c.bytes_read.load(std::memory_order_relaxed),
+                  c.cache_hits.load(std::memory_order_relaxed),
+                  c.cache_misses.load(std::memory_order_relaxed)};
+}
+
+/**
+ * @brief The counts of all the phases so far.
+ */
+IOStats::Counters IOStats::snapshot() {
+  Counters total;
+  for (size_t p = 0; p < num_phases; ++p) {
+    Counters c = snapshot(static_cast<Phase>(p));
+    total.opens += c.opens;
+    total.reads += c.reads;
+    total.bytes_read += c.bytes_read;
+    total.cache_hits += c.cache_hits;
+    total.cache_misses += c.cache_misses;
+  }
+  return total;
+}
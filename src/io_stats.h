@@ -0,0 +1,68 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+/**
+ * @brief Process wide counters of the file I/O done to find the duplicates.
+ * Every open of a file for reading, every read (a mapped window or an io_uring
+ * completion counts as one) and every lookup in the hash cache is counted.
+ * The counters are relaxed atomics, so a snapshot taken while other threads
+ * read is only approximately consistent.
+ *
+ * The I/O is also counted by the phase the thread doing it is in, so stages
+ * which run at the same time can still be told apart.
+ */
+namespace IOStats {
+struct Counters {
+  uint64_t opens{0};
+  uint64_t reads{0};
+  uint64_t bytes_read{0};
+  uint64_t cache_hits{0};
+  uint64_t cache_misses{0};
+
+  Counters operator-(const Counters &other) const;
+};
+
+enum class Phase : size_t { other, hash, compare };
+constexpr size_t num_phases = 3;
+
+/**
+ * @brief Counts the I/O of the calling thread towards a phase for as long as
+ * it lives.
+ */
+class PhaseScope {
+public:
+  explicit PhaseScope(Phase phase);
+  ~PhaseScope();
+  PhaseScope(const PhaseScope &) = delete;
+  PhaseScope &operator=(const PhaseScope &) = delete;
+
+private:
+  Phase previous;
+};
+
+void count_open();
+void count_read(size_t bytes);
+void count_cache_lookup(bool hit);
+Counters snapshot();
+Counters snapshot(Phase phase);
+} // namespace IOStats
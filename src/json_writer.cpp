@@ -0,0 +1,90 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "json_writer.h"
+
+#include <nlohmann/json.hpp> // for json
+
+/**
+ * @brief Construct a JsonSetWriter.
+ *
+ * @param _out The stream to write to.
+ * @param _format The format to write in.
+ */
+JsonSetWriter::JsonSetWriter(std::ostream &_out, Format _format)
+    : out(_out), format(_format) {}
+
+/**
+ * @brief Write a set.  Sets of less than two files are skipped.
+ *
+ * @param table The files.
+ * @param set The files of the set.
+ * @param same_inode Whether the paths of the set share an inode.
+ */
+void JsonSetWriter::write(const FileTable &table,
+                          std::span<const FileTable::Index> set,
+                          bool same_inode) {
+  if (set.size() < 2)
+    return;
+  bool pretty = format == Format::json;
+  if (pretty)
+    out << (sets == 0 ? "[\n" : ",\n") << "    {\n        \"file_list\": [\n";
+  else
+    out << "{\"file_list\":[";
+  for (size_t j = 0; j < set.size(); ++j) {
+    if (pretty)
+      out << (j == 0 ? "            " : ",\n            ");
+    else if (j != 0)
+      out << ',';
+    path.clear();
+    table.append_path(set[j], path);
+    write_string(path);
+  }
+  if (pretty)
+    out << "\n        ]" << (same_inode ? ",\n        \"same_inode\": true" : "")
+        << "\n    }";
+  else
+    out << ']' << (same_inode ? ",\"same_inode\":true" : "") << "}\n";
+  ++sets;
+}
+
+/**
+ * @brief Close the document.  Must be called once, after the last set.
+ */
+void JsonSetWriter::finish() {
+  if (format == Format::json)
+    out << (sets == 0 ? "null" : "\n]") << '\n';
+  out.flush();
+}
+
+/**
+ * @brief Write a quoted JSON string.  Plain ASCII without anything to escape
+ * is written as it is, anything else goes through nlohmann::json so that the
+ * escaping, and the error for invalid UTF-8, stay the same as dump().
+ */
+void JsonSetWriter::write_string(std::string_view s) {
+  for (char c : s) {
+    auto u = static_cast<unsigned char>(c);
+    if (u < 0x20 || u >= 0x80 || c == '"' || c == '\\') {
+      out << nlohmann::json(s).dump();
+      return;
+    }
+  }
+  out << '"' << s << '"';
+}
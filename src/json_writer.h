@@ -0,0 +1,56 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+
+#include <ostream>     // for ostream
+#include <span>        // for span
+#include <string>      // for string
+#include <string_view> // for string_view
+
+#include "file_table.h" // for FileTable
+
+/**
+ * @brief Writes the sets of duplicates one at a time, as they are found,
+ * instead of building the whole document first.  Only the path being written
+ * is held in memory.
+ *
+ * In the json format the output is byte for byte what nlohmann::json's
+ * dump(4) gives for the array of sets, including "null" when there are none.
+ * In the ndjson format every set is an object of its own on one line.
+ */
+class JsonSetWriter {
+public:
+  enum class Format { json, ndjson };
+
+  JsonSetWriter(std::ostream &_out, Format _format);
+  void write(const FileTable &table, std::span<const FileTable::Index> set,
+             bool same_inode = false);
+  void finish();
+  size_t num_sets() const { return sets; }
+
+private:
+  std::ostream &out;
+  Format format;
+  size_t sets{0};
+  std::string path;
+
+  void write_string(std::string_view s);
+};
@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <chrono>
 #include <fstream>
 #include <functional>
+#include <iostream>
 #include <memory>
 
 #include "bin_compare_files.h"
@@ -27,8 +28,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 #include "filter.h"
 #include "filters_list.h"
+#include "hash_cache.h"
 #include "io.h"
+#include "json_writer.h"
+#include "page_cache.h"
+#include "pipeline.h"
+#include "read_order.h"
+#include "stats_report.h"
+#include "thread_pool.h"
+#include "throttle.h"
 #include "unistd.h"
+#include "walker.h"
 #define WITH_BIN_COMPARISON 1
 
 using std::chrono::duration;
@@ -40,34 +50,101 @@ extern bool dry_run;
 extern cxxopts::ParseResult cxxopts_results;
 
 /**
- * @brief Calculates the four common filters for the files.  size, xxash for
- * first 4KB, and the xxhash of the whole file. Then it goes ahead and compares
- * files byte by byte
+ * @brief The format of the sets printed, from --format.
+ */
+JsonSetWriter::Format output_format() {
+  return cxxopts_results["format"].as<std::string>() == "ndjson"
+             ? JsonSetWriter::Format::ndjson
+             : JsonSetWriter::Format::json;
+}
+
+/**
+ * @brief Calculates the common filters for the files.  size, then the xxhash
+ * of growing prefixes up to the whole file. Then it goes ahead and compares
+ * files byte by byte.  Paths sharing an inode are collapsed beforehand so that
+ * every inode is read only once.  The hashing and the comparison run through
+ * the Pipeline one size group at a time, and with print the sets are written
+ * out as soon as they are confirmed.
  *
- * @param file_sets The FileSets to apply filters to.
- * @param result The resulting FileSets object after applyint the filter.
- * @param print Whether or not to print the FileSets object in json format.
+ * @param table The files.  The full hashes of the duplicates are kept in it.
+ * @param groups The groups to apply filters to.
+ * @param result The resulting groups after applying the filters.
+ * @param same_inode_groups The groups of paths found to share an inode.
+ * @param print Whether or not to print the groups in json format.
+ * @param pool The pool the stages run on, nullptr to run them serially.
+ * @param stats Gets a measurement of every stage, if given.
  */
-void apply_four_common_filters(const FileSets &file_sets, FileSets &result,
-                               bool print = true) {
-  HashableFilter filter_1{file_sets, FiltersList::file_size};
-  HashableFilter filter_2{filter_1.new_file_sets, FiltersList::xxhash_4KB};
-  HashableFilter filter_3{filter_2.new_file_sets, FiltersList::xxhash};
+void apply_four_common_filters(FileTable &table, const IndexGroups &groups,
+                               IndexGroups &result,
+                               IndexGroups &same_inode_groups,
+                               bool print = true, ThreadPool *pool = nullptr,
+                               StatsReport *stats = nullptr) {
+  auto start = [&](const char *name, const IndexGroups &in) {
+    if (stats != nullptr)
+      stats->start(name, table, in);
+  };
+  auto stop = [&](const IndexGroups &out) {
+    if (stats != nullptr)
+      stats->stop(out);
+  };
+  start("same_inode", groups);
+  TableSameInodeFilter filter_0{table, groups};
+  same_inode_groups = std::move(filter_0.same_inode_groups);
+  stop(filter_0.new_groups);
+  start("size", filter_0.new_groups);
+  TableHashableFilter filter_1{
+      table, filter_0.new_groups,
+      [](const FileTable &t, FileTable::Index i) { return t.file_size(i); },
+      pool};
+  stop(filter_1.new_groups);
+  if (cxxopts_results.count("sort-reads")) {
+    start("read_order", filter_1.new_groups);
+    ReadOrder::assign_keys(table, filter_1.new_groups, pool);
+    stop(filter_1.new_groups);
+  }
 
-#if WITH_BIN_COMPARISON == 1
   auto t1 = high_resolution_clock::now();
-  NonHashableFilter filter_4{filter_3.new_file_sets, compare_files_fdupes};
+  start("hash_and_compare", filter_1.new_groups);
+  JsonSetWriter writer{std::cout, output_format()};
+  result = IndexGroups{};
+  Pipeline::run(table, filter_1.new_groups, pool, WITH_BIN_COMPARISON == 1,
+                [&](std::span<const FileTable::Index> set) {
+                  if (print) {
+                    if (writer.num_sets() == 0)
+                      IO::end_animation();
+                    writer.write(table, set);
+                  }
+                  result.add(set);
+                });
+  stop(result);
   IO::end_animation();
   auto t2 = high_resolution_clock::now();
-  spdlog::info("Bin comparison time: {}",
+  spdlog::info("Hash and comparison time: {}",
                (duration<double, std::milli>{t2 - t1}).count());
-  if (print)
-    IO::print_json(filter_4.new_file_sets);
-#else
-  if (print)
-    IO::print_json(filter_2.new_file_sets);
-#endif
-  result = std::move(filter_3.new_file_sets);
+  if (print) {
+    for (size_t i = 0; i < same_inode_groups.size(); ++i)
+      writer.write(table, same_inode_groups[i], true);
+    writer.finish();
+  }
+}
+
+/**
+ * @brief The predicates of --walk from the options.
+ */
+WalkOptions walk_options() {
+  WalkOptions options;
+  std::string type = cxxopts_results["type"].as<std::string>();
+  options.accepted.clear();
+  if (type.find('f') != std::string::npos)
+    options.accepted.insert(FileType::regular_file);
+  if (type.find('l') != std::string::npos)
+    options.accepted.insert(FileType::symlinked_file);
+  if (cxxopts_results.count("min-size"))
+    options.min_size = cxxopts_results["min-size"].as<uint64_t>();
+  if (cxxopts_results.count("max-size"))
+    options.max_size = cxxopts_results["max-size"].as<uint64_t>();
+  options.same_filesystem = cxxopts_results.count("xdev") > 0;
+  return options;
 }
 
 int main(int argc, char *argv[]) {
@@ -81,7 +158,10 @@ int main(int argc, char *argv[]) {
   } catch (std::runtime_error &exp) {
     std::string exp_string = std::string(exp.what());
     if (exp_string == "Incompatible options." ||
-        exp_string.starts_with("The dry-run option takes an input.")) {
+        exp_string.starts_with("The dry-run option takes an input.") ||
+        exp_string.starts_with("The threads option takes") ||
+        exp_string.starts_with("The type option takes") ||
+        exp_string.starts_with("The format option takes")) {
       std::cout << exp.what() << std::endl;
       exit(1);
     } else
@@ -91,15 +171,77 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 
-  FileSets input_file_sets, resulting_file_sets;
-  IO::parse_input(input_file_sets);
+  // Before the pool, so its threads start in the idle classes as well.
+  if (cxxopts_results.count("idle"))
+    Throttle::enter_idle();
+  Throttle::Limits limits;
+  if (cxxopts_results.count("max-read-rate"))
+    limits.read_rate = cxxopts_results["max-read-rate"].as<uint64_t>();
+  if (cxxopts_results.count("max-iops"))
+    limits.iops = cxxopts_results["max-iops"].as<uint64_t>();
+  Throttle::set_limits(limits);
+  if (cxxopts_results.count("control-file"))
+    Throttle::watch(cxxopts_results["control-file"].as<std::string>());
+
+  std::unique_ptr<ThreadPool> pool;
+  size_t num_threads = cxxopts_results["threads"].as<size_t>();
+  if (num_threads > 1)
+    pool = std::make_unique<ThreadPool>(num_threads);
+
+  FiltersList::set_read_queue_depth(
+      cxxopts_results["queue-depth"].as<size_t>());
+  bool direct_io = cxxopts_results.count("direct-io") > 0;
+  PageCache::set_bypass(direct_io);
+  FiltersList::set_mmap_threshold(
+      direct_io ? 0 : cxxopts_results["mmap-threshold"].as<uint64_t>());
+
+  std::unique_ptr<HashCache> hash_cache;
+  if (cxxopts_results.count("cache")) {
+    hash_cache =
+        std::make_unique<HashCache>(cxxopts_results["cache"].as<std::string>());
+    FiltersList::set_hash_cache(hash_cache.get());
+  }
+
+  std::unique_ptr<StatsReport> stats;
+  if (cxxopts_results.count("stats"))
+    stats = std::make_unique<StatsReport>();
+
+  FileTable table;
+  IndexGroups input_groups, resulting_groups, same_inode_groups;
+  // Heads are hashed while the paths come in, before the filters run.
+  std::unique_ptr<EagerHasher> eager;
+  if (cxxopts_results.count("eager"))
+    eager = std::make_unique<EagerHasher>(table, pool.get());
+  std::string files_from = cxxopts_results.count("files-from")
+                               ? cxxopts_results["files-from"].as<std::string>()
+                               : "";
+  if (stats)
+    stats->start("input", table, input_groups);
+  try {
+    if (cxxopts_results.count("walk"))
+      Walker::walk(cxxopts_results["walk"].as<std::vector<std::string>>(),
+                   walk_options(), table, input_groups, pool.get());
+    else
+      IO::parse_input(table, input_groups, pool.get(), files_from,
+                      eager.get());
+  } catch (std::runtime_error &exp) {
+    std::cout << exp.what() << std::endl;
+    exit(1);
+  }
+  if (eager)
+    eager->finish();
+  if (stats)
+    stats->stop(input_groups);
 
   if (cxxopts_results.count("dry-run"))
     dry_run = true;
 
   if (cxxopts_results.count("delete")) {
-    apply_four_common_filters(input_file_sets, resulting_file_sets, false);
-    if (!resulting_file_sets.empty()) {
+    apply_four_common_filters(table, input_groups, resulting_groups,
+                              same_inode_groups, false, pool.get(),
+                              stats.get());
+    if (!resulting_groups.empty()) {
+      FileSets resulting_file_sets = to_file_sets(table, resulting_groups);
       KeepFileSets kps(resulting_file_sets.size());
       for (size_t i = 0; i < resulting_file_sets.size(); ++i) {
         size_t N = resulting_file_sets.at(i).size();
@@ -108,10 +250,24 @@ int main(int argc, char *argv[]) {
       IO::remove_file_io(resulting_file_sets, kps);
     }
   } else if (cxxopts_results.count("summary")) {
-    apply_four_common_filters(input_file_sets, resulting_file_sets, false);
-    IO::print_summary(resulting_file_sets);
+    apply_four_common_filters(table, input_groups, resulting_groups,
+                              same_inode_groups, false, pool.get(),
+                              stats.get());
+    IO::print_summary(table, resulting_groups, same_inode_groups);
   } else {
-    apply_four_common_filters(input_file_sets, resulting_file_sets, true);
+    apply_four_common_filters(table, input_groups, resulting_groups,
+                              same_inode_groups, true, pool.get(),
+                              stats.get());
+  }
+  if (hash_cache != nullptr)
+    hash_cache->save();
+  if (stats) {
+    try {
+      stats->write(cxxopts_results["stats"].as<std::string>());
+    } catch (std::runtime_error &exp) {
+      std::cout << exp.what() << std::endl;
+      return 1;
+    }
   }
   return 0;
 }
@@ -0,0 +1,192 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "mmap_reader.h"
+
+#include <fcntl.h>    // for open, O_RDONLY
+#include <setjmp.h>   // for sigjmp_buf, sigsetjmp, siglongjmp
+#include <signal.h>   // for sigaction, raise, SIGBUS
+#include <sys/mman.h> // for mmap, munmap, madvise
+#include <sys/stat.h> // for fstat
+#include <unistd.h>   // for close, sysconf
+
+#include <algorithm> // for min
+#include <atomic>    // for atomic_signal_fence
+#include <mutex>     // for call_once
+
+#include "debug.h"    // for warn
+#include "io_stats.h" // for IOStats
+#include "sparse.h"   // for Sparse
+#include "throttle.h" // for Throttle
+
+namespace {
+struct sigaction previous_bus_action;
+std::once_flag bus_handler_installed;
+// Set while the calling thread reads from a mapping.
+thread_local sigjmp_buf *bus_jump{nullptr};
+
+/**
+ * @brief SIGBUS is raised when a mapped page past the end of the file is
+ * touched, i.e. when the file was truncated while we were reading it.  Jump
+ * back into feed_mapped() in that case, otherwise hand the signal on to the
+ * previous handler, staying installed for the next read.
+ */
+void bus_handler(int signal_number, siginfo_t *info, void *context) {
+  if (bus_jump != nullptr)
+    siglongjmp(*bus_jump, 1);
+  if (previous_bus_action.sa_flags & SA_SIGINFO) {
+    previous_bus_action.sa_sigaction(signal_number, info, context);
+  } else if (previous_bus_action.sa_handler == SIG_DFL) {
+    // The default action ends the process.
+    sigaction(SIGBUS, &previous_bus_action, nullptr);
+    raise(SIGBUS);
+  } else if (previous_bus_action.sa_handler != SIG_IGN) {
+    previous_bus_action.sa_handler(signal_number);
+  }
+}
+
+void install_bus_handler() {
+  struct sigaction action {};
+  action.sa_sigaction = bus_handler;
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGBUS, &action, &previous_bus_action);
+}
+
+/**
+ * @brief Hand a mapping to on_block, catching the SIGBUS of a truncated file.
+ * Only the C callback runs between sigsetjmp and a siglongjmp, so the jump
+ * leaves no C++ frame behind and no local is modified after sigsetjmp.
+ *
+ * @return true if on_block got the bytes and false if the file was truncated.
+ */
+bool feed_mapped(MmapReader::BlockCallback on_block, void *context,
+                 const unsigned char *data, size_t size) {
+  sigjmp_buf jump;
+  if (sigsetjmp(jump, 1) != 0) {
+    bus_jump = nullptr;
+    return false;
+  }
+  // The fences keep the compiler from moving the stores to bus_jump, which
+  // only the signal handler reads, past the callback.
+  bus_jump = &jump;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  on_block(context, data, size);
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  bus_jump = nullptr;
+  return true;
+}
+} // namespace
+
+/**
+ * @brief Read a file through a mapping instead of read(2) calls.  At most
+ * window_size bytes are mapped at a time, with MADV_SEQUENTIAL so the kernel
+ * reads ahead and drops the pages behind us.  on_block gets the mapped window
+ * itself, nothing is copied.  If the file is truncated while it is read, the
+ * SIGBUS is caught and the read fails.  The holes of a sparse file are not
+ * mapped, on_block gets zeros for them instead.
+ *
+ * @param path The file to read.
+ * @param start The offset to start reading at.
+ * @param limit The offset to stop reading at, 0 for the end of the file.
+ * @param on_block Called with every window, in order.
+ * @param context Passed on to on_block.
+ * @param window_size The size of the window.
+ *
+ * @return true if the file was read and false otherwise.
+ */
+bool MmapReader::read_range(const std::string &path, uint64_t start,
+                            uint64_t limit, BlockCallback on_block,
+                            void *context, size_t window_size) {
+  std::call_once(bus_handler_installed, install_bus_handler);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    spdlog::warn("Could not open file, skipping: {}", path);
+    return false;
+  }
+  IOStats::count_open();
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    spdlog::warn("Could not stat file, skipping: {}", path);
+    return false;
+  }
+  uint64_t end = static_cast<uint64_t>(st.st_size);
+  if (limit != 0)
+    end = std::min(end, limit);
+
+  // Mappings start on a page boundary, the bytes before `offset` are skipped.
+  const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  // Holes are handed on as zeros instead of being mapped.
+  Sparse::Extents extents{fd, st};
+  bool ok = true;
+  for (uint64_t offset = start; offset < end && ok;) {
+    uint64_t hole = extents.hole(offset, end);
+    if (hole != 0) {
+      Sparse::feed_zeros(hole,
+                         [on_block, context](const unsigned char *data,
+                                             size_t size) {
+                           on_block(context, data, size);
+                         });
+      offset += hole;
+      continue;
+    }
+    size_t skip = static_cast<size_t>(offset % page_size);
+    size_t size = static_cast<size_t>(std::min<uint64_t>(
+        window_size, std::min(end, extents.data_end(offset)) - offset));
+    void *window = mmap(nullptr, skip + size, PROT_READ, MAP_SHARED, fd,
+                        static_cast<off_t>(offset - skip));
+    if (window == MAP_FAILED) {
+      spdlog::warn("Could not map file, skipping: {}", path);
+      ok = false;
+      break;
+    }
+    madvise(window, skip + size, MADV_SEQUENTIAL);
+    IOStats::count_read(size);
+    Throttle::account(size);
+
+    if (!feed_mapped(on_block, context,
+                     static_cast<const unsigned char *>(window) + skip,
+                     size)) {
+      spdlog::warn("File truncated while reading, skipping: {}", path);
+      ok = false;
+    }
+    munmap(window, skip + size);
+    offset += size;
+  }
+  close(fd);
+  return ok;
+}
+
+/**
+ * @brief Read a file from the start through read_range().
+ *
+ * @param path The file to read.
+ * @param limit The number of bytes to read, 0 for the whole file.
+ * @param on_block Called with every window, in order.
+ * @param context Passed on to on_block.
+ * @param window_size The size of the window.
+ *
+ * @return true if the file was read and false otherwise.
+ */
+bool MmapReader::read_file(const std::string &path, uint64_t limit,
+                           BlockCallback on_block, void *context,
+                           size_t window_size) {
+  return read_range(path, 0, limit, on_block, context, window_size);
+}
@@ -0,0 +1,41 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <string> // for string
+
+namespace MmapReader {
+// Runs on the mapped bytes while the SIGBUS of a truncated file is caught, and
+// is left by a siglongjmp then, so it is a plain C function.
+using BlockCallback = void (*)(void *context, const unsigned char *data,
+                               size_t size);
+
+// The size of the mapped window, at most this much of a file is mapped at
+// once.
+constexpr size_t default_window_size = 64 * (1 << 20);
+
+bool read_range(const std::string &path, uint64_t offset, uint64_t limit,
+                BlockCallback on_block, void *context,
+                size_t window_size = default_window_size);
+bool read_file(const std::string &path, uint64_t limit, BlockCallback on_block,
+               void *context, size_t window_size = default_window_size);
+} // namespace MmapReader
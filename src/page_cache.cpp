@@ -0,0 +1,183 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "page_cache.h"
+
+#include <errno.h>    // for errno, EINTR, EINVAL
+#include <fcntl.h>    // for open, fcntl, posix_fadvise, O_DIRECT
+#include <stdlib.h>   // for aligned_alloc, free
+#include <sys/mman.h> // for mmap, munmap, madvise
+#include <unistd.h>   // for close, read, pread
+
+#include <algorithm> // for max
+#include <atomic>    // for atomic
+#include <new>       // for bad_alloc
+#include <utility>   // for pair
+#include <vector>    // for vector
+
+namespace {
+std::atomic<bool> bypassing{false};
+
+// Buffers at least this large are mapped, for huge pages.
+constexpr size_t huge_size = 2 * (1 << 20);
+// The most buffers a thread keeps for reuse, and the largest it keeps.
+constexpr size_t pool_size = 4;
+constexpr size_t max_pooled = 4 * (1 << 20);
+
+unsigned char *allocate(size_t size) {
+  if (size >= huge_size) {
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+      throw std::bad_alloc();
+    madvise(mapped, size, MADV_HUGEPAGE);
+    return static_cast<unsigned char *>(mapped);
+  }
+  void *allocated = aligned_alloc(PageCache::alignment, size);
+  if (allocated == nullptr)
+    throw std::bad_alloc();
+  return static_cast<unsigned char *>(allocated);
+}
+
+void deallocate(unsigned char *bytes, size_t size) {
+  if (size >= huge_size)
+    munmap(bytes, size);
+  else
+    free(bytes);
+}
+
+/**
+ * @brief The buffers given back on a thread, freed when it ends.  Buffers of
+ * other thread_locals may outlive it, they are freed directly then.
+ */
+struct Pool {
+  std::vector<std::pair<unsigned char *, size_t>> free_buffers;
+
+  ~Pool() {
+    for (auto [bytes, size] : free_buffers)
+      deallocate(bytes, size);
+    closed = true;
+  }
+  static thread_local bool closed;
+};
+thread_local bool Pool::closed{false};
+thread_local Pool pool;
+} // namespace
+
+void PageCache::set_bypass(bool bypass) {
+  bypassing.store(bypass, std::memory_order_relaxed);
+}
+
+bool PageCache::bypass() { return bypassing.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Open a file for reading, with O_DIRECT when bypassing the page
+ * cache and the filesystem takes it.
+ *
+ * @return The file descriptor, or -1 with errno set.
+ */
+int PageCache::open(const char *path) {
+  if (bypass()) {
+    int fd = ::open(path, O_RDONLY | O_DIRECT);
+    if (fd >= 0 || errno != EINVAL)
+      return fd;
+  }
+  return ::open(path, O_RDONLY);
+}
+
+/**
+ * @brief Clear O_DIRECT from a file after a read was refused with EINVAL.
+ *
+ * @return true if the file had O_DIRECT, so the read is worth retrying.
+ */
+bool PageCache::fall_back(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || (flags & O_DIRECT) == 0)
+    return false;
+  return fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+/**
+ * @brief read() for a file from open(), retrying interrupted reads and the
+ * reads O_DIRECT refuses.
+ */
+ssize_t PageCache::read(int fd, unsigned char *buffer, size_t size) {
+  while (true) {
+    ssize_t r = ::read(fd, buffer, size);
+    if (r < 0 && (errno == EINTR || (errno == EINVAL && fall_back(fd))))
+      continue;
+    return r;
+  }
+}
+
+/**
+ * @brief pread() for a file from open(), retrying interrupted reads and the
+ * reads O_DIRECT refuses.
+ */
+ssize_t PageCache::pread(int fd, unsigned char *buffer, size_t size,
+                         uint64_t offset) {
+  while (true) {
+    ssize_t r = ::pread(fd, buffer, size, static_cast<off_t>(offset));
+    if (r < 0 && (errno == EINTR || (errno == EINVAL && fall_back(fd))))
+      continue;
+    return r;
+  }
+}
+
+/**
+ * @brief Close a file from open().  When bypassing the page cache, the pages
+ * of a file which was read through it are dropped first.
+ */
+void PageCache::close(int fd) {
+  if (bypass()) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0 && (flags & O_DIRECT) == 0)
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+  ::close(fd);
+}
+
+PageCache::Buffer::Buffer(size_t size)
+    : length{round_up(std::max<size_t>(size, 1))} {
+  if (Pool::closed) {
+    bytes = allocate(length);
+    return;
+  }
+  for (auto it = pool.free_buffers.begin(); it != pool.free_buffers.end();
+       ++it)
+    if (it->second == length) {
+      bytes = it->first;
+      pool.free_buffers.erase(it);
+      return;
+    }
+  bytes = allocate(length);
+}
+
+PageCache::Buffer::~Buffer() {
+  if (Pool::closed || length > max_pooled) {
+    deallocate(bytes, length);
+    return;
+  }
+  if (pool.free_buffers.size() == pool_size) {
+    deallocate(pool.free_buffers.front().first,
+               pool.free_buffers.front().second);
+    pool.free_buffers.erase(pool.free_buffers.begin());
+  }
+  pool.free_buffers.emplace_back(bytes, length);
+}
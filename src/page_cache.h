@@ -0,0 +1,69 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h>    // for size_t
+#include <stdint.h>    // for uint64_t
+#include <sys/types.h> // for ssize_t
+
+/**
+ * @brief Reading files without leaving them in the page cache.  When bypassing
+ * is on, files are opened with O_DIRECT, so the data of the other programs on
+ * the machine stays cached while undupes reads everything once.  A read
+ * O_DIRECT refuses, being unaligned or on a filesystem without it, clears
+ * O_DIRECT from the file and is done through the page cache instead, and the
+ * pages of such a file are dropped with POSIX_FADV_DONTNEED when it is closed.
+ */
+namespace PageCache {
+// The alignment of the offsets, sizes and buffers of O_DIRECT reads.
+constexpr size_t alignment = 4096;
+
+void set_bypass(bool bypass);
+bool bypass();
+int open(const char *path);
+ssize_t read(int fd, unsigned char *buffer, size_t size);
+ssize_t pread(int fd, unsigned char *buffer, size_t size, uint64_t offset);
+bool fall_back(int fd);
+void close(int fd);
+
+constexpr size_t round_up(size_t size) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * @brief A buffer aligned for O_DIRECT, taken from a pool of the calling
+ * thread and given back to it when destroyed, so reading many files does
+ * not allocate for every one.  Buffers of 2MB and more are mapped and backed
+ * by transparent huge pages where the kernel allows.
+ */
+class Buffer {
+public:
+  explicit Buffer(size_t size);
+  ~Buffer();
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+
+  unsigned char *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  unsigned char *bytes;
+  size_t length;
+};
+} // namespace PageCache
@@ -0,0 +1,150 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "path_list_reader.h"
+
+#include <errno.h>    // for errno, EINTR
+#include <fcntl.h>    // for open, O_RDONLY
+#include <string.h>   // for memchr, memcpy, memmove, strerror
+#include <sys/mman.h> // for mmap, munmap, madvise
+#include <sys/stat.h> // for fstat
+#include <unistd.h>   // for read, close
+
+#include <algorithm> // for max
+#include <stdexcept> // for runtime_error
+
+#include "debug.h" // for format
+
+/**
+ * @brief Open the list.
+ *
+ * @param file The file holding the list, empty for stdin.  Throws a
+ * runtime_error if it cannot be opened.
+ */
+PathListReader::PathListReader(const std::string &file) {
+  if (!file.empty()) {
+    fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::runtime_error(fmt::format("Cannot open file list: {}: {}",
+                                           file, strerror(errno)));
+    owns_fd = true;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return;
+  size_t size = st.st_size;
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    return;
+  madvise(data, size, MADV_SEQUENTIAL);
+  // The views point into the mapping, so it goes away with the last chunk.
+  buffer = std::shared_ptr<char[]>(static_cast<char *>(data),
+                                   [size](char *p) { munmap(p, size); });
+  used = size;
+  mapped = true;
+  eof = true;
+}
+
+PathListReader::~PathListReader() {
+  if (owns_fd)
+    close(fd);
+}
+
+/**
+ * @brief Hand out the next paths.  The paths of a chunk all point into one
+ * buffer, so a chunk may hold fewer than max_paths paths even before the end
+ * of the list.
+ *
+ * @param chunk Set to the next paths.
+ * @param max_paths The largest number of paths to put in the chunk.
+ *
+ * @return false at the end of the list and true otherwise.
+ */
+bool PathListReader::next(Chunk &chunk, size_t max_paths) {
+  chunk.paths.clear();
+  while (chunk.paths.size() < max_paths) {
+    const char *data = buffer.get();
+    // memchr scans a word or a vector register at a time.
+    const char *nul =
+        pos < used ? static_cast<const char *>(
+                         memchr(data + pos, '\0', used - pos))
+                   : nullptr;
+    if (nul != nullptr) {
+      chunk.paths.emplace_back(data + pos, nul - (data + pos));
+      pos = nul - data + 1;
+      continue;
+    }
+    // The last path of the buffer is cut off, or the buffer is used up.
+    if (!chunk.paths.empty() || !fill())
+      break;
+  }
+  chunk.buffer = buffer;
+  return !chunk.paths.empty();
+}
+
+/**
+ * @brief Move the unfinished path at the end of the buffer to the start of a
+ * new one and read what is available after it, at most a block.  At the end
+ * of the list a NUL is put after an unterminated last path.
+ *
+ * @return false if there is nothing left to hand out and true otherwise.
+ */
+bool PathListReader::fill() {
+  size_t tail = used - pos;
+  if (eof) {
+    if (tail == 0)
+      return false;
+    // Copy the unterminated last path, the mapping may end right after it.
+    std::shared_ptr<char[]> last(new char[tail + 1]);
+    memcpy(last.get(), buffer.get() + pos, tail);
+    last[tail] = '\0';
+    buffer = last;
+    pos = 0;
+    used = tail + 1;
+    return true;
+  }
+
+  // Chunks handed out may still point into the buffer, it is only reused
+  // once they are all gone.
+  size_t size = std::max(block_size, 2 * tail);
+  if (buffer == nullptr || buffer.use_count() > 1 || size > capacity) {
+    std::shared_ptr<char[]> next_buffer(new char[size]);
+    if (tail > 0)
+      memcpy(next_buffer.get(), buffer.get() + pos, tail);
+    buffer = next_buffer;
+    capacity = size;
+  } else if (tail > 0)
+    memmove(buffer.get(), buffer.get() + pos, tail);
+  pos = 0;
+  used = tail;
+  // One read is enough: the paths a slow pipe has written so far go on to be
+  // probed instead of waiting for the rest of the block.
+  ssize_t n;
+  do
+    n = read(fd, buffer.get() + used, capacity - used);
+  while (n < 0 && errno == EINTR);
+  if (n < 0)
+    spdlog::warn("Error reading the file list: {}", strerror(errno));
+  if (n <= 0)
+    eof = true;
+  else
+    used += n;
+  return used > 0;
+}
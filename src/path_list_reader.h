@@ -0,0 +1,66 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+
+#include <memory>      // for shared_ptr
+#include <string>      // for string
+#include <string_view> // for string_view
+#include <vector>      // for vector
+
+/**
+ * @brief Reads a NUL separated list of paths in bulk and hands it out as
+ * chunks of views into the data read.  A regular file is mapped, anything else
+ * is read in large blocks.  Every path of a chunk is followed by a NUL in
+ * memory, so it can be passed to the system calls as it is.
+ */
+class PathListReader {
+public:
+  /**
+   * @brief Some paths of the list.  The views stay valid while `buffer` is
+   * held, whatever the reader does meanwhile.
+   */
+  struct Chunk {
+    std::shared_ptr<const char[]> buffer;
+    std::vector<std::string_view> paths;
+  };
+
+  explicit PathListReader(const std::string &file = "");
+  ~PathListReader();
+  PathListReader(const PathListReader &) = delete;
+  PathListReader &operator=(const PathListReader &) = delete;
+
+  bool next(Chunk &chunk, size_t max_paths);
+  bool is_mapped() const { return mapped; }
+
+private:
+  static constexpr size_t block_size = 1 << 20;
+
+  int fd{0};
+  bool owns_fd{false};
+  bool mapped{false};
+  bool eof{false};
+
+  // The data not handed out yet is [pos, used) of buffer.
+  std::shared_ptr<char[]> buffer;
+  size_t pos{0}, used{0}, capacity{0};
+
+  bool fill();
+};
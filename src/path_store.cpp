@@ -0,0 +1,127 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "path_store.h"
+
+#include <string.h> // for memcpy
+
+#include <algorithm> // for max
+#include <limits>    // for numeric_limits
+#include <optional>  // for optional
+#include <stdexcept> // for runtime_error
+
+/**
+ * @brief Add a path.  Every component but the last is a directory and is
+ * looked up, and added if new, below the previous one.
+ *
+ * @param path The path.
+ *
+ * @return The id of the path and a runtime_error if the store is full.
+ */
+PathStore::Id PathStore::add(std::string_view path) {
+  if (size() >= std::numeric_limits<Id>::max())
+    throw std::runtime_error("Too many files.");
+  uint32_t dir = 0;
+  for (size_t slash; (slash = path.find('/')) != std::string_view::npos;) {
+    dir = intern_dir(dir, path.substr(0, slash));
+    path.remove_prefix(slash + 1);
+  }
+  dirs_of.push_back(dir);
+  name_bytes.insert(name_bytes.end(), path.begin(), path.end());
+  name_ends.push_back(name_bytes.size());
+  return static_cast<Id>(size() - 1);
+}
+
+void PathStore::reserve(size_t num_paths) {
+  dirs_of.reserve(num_paths);
+  name_ends.reserve(num_paths);
+}
+
+/**
+ * @brief Rebuild a path.
+ *
+ * @param id The id of the path.
+ *
+ * @return The path, as it was added.
+ */
+std::string PathStore::path(Id id) const {
+  std::string out;
+  append_path(id, out);
+  return out;
+}
+
+/**
+ * @brief Append a path to a string, which saves an allocation when the string
+ * is reused for many paths.
+ *
+ * @param id The id of the path.
+ * @param out The string to append to.
+ */
+void PathStore::append_path(Id id, std::string &out) const {
+  if (dirs_of[id] != 0) {
+    append_dir(dirs_of[id], out);
+    out.push_back('/');
+  }
+  uint64_t begin = id == 0 ? 0 : name_ends[id - 1];
+  out.append(name_bytes.data() + begin, name_ends[id] - begin);
+}
+
+void PathStore::append_dir(uint32_t dir, std::string &out) const {
+  const Dir &d = dirs.key(dir - 1);
+  if (d.parent != 0) {
+    append_dir(d.parent, out);
+    out.push_back('/');
+  }
+  out.append(d.name);
+}
+
+/**
+ * @brief Copy a directory name into the blocks.
+ *
+ * @param name The name.
+ *
+ * @return A view of the copy.
+ */
+std::string_view PathStore::intern(std::string_view name) {
+  if (name.empty())
+    return {};
+  if (block_used + name.size() > block_size) {
+    blocks.emplace_back(new char[std::max(block_size, name.size())]);
+    block_used = 0;
+  }
+  char *copy = blocks.back().get() + block_used;
+  memcpy(copy, name.data(), name.size());
+  block_used += name.size();
+  return {copy, name.size()};
+}
+
+/**
+ * @brief Find a directory, adding it if it is not there yet.
+ *
+ * @param parent The parent directory, 0 for none.
+ * @param name The last component of the directory.
+ *
+ * @return The directory, numbered from 1.
+ */
+uint32_t PathStore::intern_dir(uint32_t parent, std::string_view name) {
+  std::optional<uint32_t> index = dirs.find(Dir{parent, name});
+  if (!index)
+    index = dirs.insert(Dir{parent, intern(name)}).first;
+  return *index + 1;
+}
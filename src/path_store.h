@@ -0,0 +1,77 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint32_t, uint64_t
+
+#include <functional>  // for hash
+#include <memory>      // for unique_ptr
+#include <string>      // for string
+#include <string_view> // for string_view
+#include <vector>      // for vector
+
+#include "flat_index_map.h" // for FlatIndexMap
+
+/**
+ * @brief The paths of a run, with their directories interned.  A directory is
+ * stored once, as its parent and its last component, and a path as its
+ * directory and its file name, so the prefixes shared by the files of a tree
+ * cost nothing per file.  The paths are rebuilt byte for byte on demand.
+ */
+class PathStore {
+public:
+  using Id = uint32_t;
+
+  Id add(std::string_view path);
+  void reserve(size_t num_paths);
+
+  size_t size() const { return dirs_of.size(); }
+  size_t num_dirs() const { return dirs.size(); }
+  std::string path(Id id) const;
+  void append_path(Id id, std::string &out) const;
+
+private:
+  // A directory below `parent`, 0 standing for no directory at all.
+  struct Dir {
+    uint32_t parent;
+    std::string_view name;
+    bool operator==(const Dir &other) const = default;
+  };
+  struct DirHash {
+    size_t operator()(const Dir &d) const noexcept {
+      return std::hash<std::string_view>{}(d.name) ^ (size_t{d.parent} << 1);
+    }
+  };
+  static constexpr size_t block_size = 64 * (1 << 10);
+
+  std::string_view intern(std::string_view name);
+  uint32_t intern_dir(uint32_t parent, std::string_view name);
+  void append_dir(uint32_t dir, std::string &out) const;
+
+  // The directory names live in blocks which never move, so the views into
+  // them stay valid as the store grows.
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t block_used{block_size};
+  FlatIndexMap<Dir, DirHash> dirs;
+
+  std::vector<uint32_t> dirs_of;
+  std::vector<char> name_bytes;
+  std::vector<uint64_t> name_ends;
+};
@@ -0,0 +1,414 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "pipeline.h"
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <algorithm>     // for min, min_element, sort, stable_sort
+#include <atomic>        // for atomic
+#include <exception>     // for exception_ptr, current_exception
+#include <memory>        // for make_shared, shared_ptr
+#include <mutex>         // for mutex, lock_guard
+#include <numeric>       // for iota
+#include <optional>      // for optional
+#include <string>        // for string
+#include <unordered_map> // for unordered_map
+#include <utility>       // for move
+#include <vector>        // for vector
+
+#include "bin_compare_files.h" // for compare_files_lockstep_chunked
+#include "bounded_queue.h"     // for BoundedQueue
+#include "device_profile.h"    // for DeviceProfile, DeviceProfiles
+#include "filter.h"            // for add_classes
+#include "filters_list.h"      // for FiltersList
+#include "flat_index_map.h"    // for FlatIndexMap
+#include "io_stats.h"          // for IOStats
+#include "read_order.h"        // for ReadOrder
+
+namespace {
+/**
+ * @brief Split a size group into its sets of duplicates.
+ *
+ * @param table The files.
+ * @param group The files of one size.
+ * @param compare Whether to compare the files byte by byte after hashing.
+ * @param result Gets the sets.
+ */
+void verify_group(FileTable &table, std::span<const FileTable::Index> group,
+                  bool compare, IndexGroups &result) {
+  std::vector<FileTable::Index> set;
+  std::vector<std::string> paths;
+  FileClasses classes;
+  {
+    IOStats::PhaseScope phase{IOStats::Phase::hash};
+    classes = FiltersList::xxhash_progressive(table, group);
+  }
+  IOStats::PhaseScope phase{IOStats::Phase::compare};
+  for (const auto &hashed : classes) {
+    if (hashed.size() < 2)
+      continue;
+    set.clear();
+    for (size_t i : hashed)
+      set.push_back(group[i]);
+    if (!compare) {
+      result.add(set);
+      continue;
+    }
+    // The set is compared in read order and its classes are put back in
+    // input order.
+    if (table.has_read_keys())
+      std::sort(set.begin(), set.end(),
+                [&table](FileTable::Index a, FileTable::Index b) {
+                  return ReadOrder::before(table, a, b);
+                });
+    paths.clear();
+    for (FileTable::Index f : set)
+      paths.push_back(table.path(f));
+    std::vector<std::vector<FileTable::Index>> same;
+    const DeviceProfile &device =
+        DeviceProfiles::get(table.dev(set.front()), paths.front().c_str());
+    for (const auto &c :
+         compare_files_lockstep_chunked(paths, device.block_size)) {
+      if (c.size() < 2)
+        continue;
+      auto &members = same.emplace_back();
+      for (size_t i : c)
+        members.push_back(set.at(i));
+      std::sort(members.begin(), members.end());
+    }
+    std::sort(same.begin(), same.end());
+    for (const auto &members : same)
+      result.add(members);
+  }
+}
+
+/**
+ * @brief The groups waiting to be verified, in a lane for every device.  A
+ * group is taken from the earliest of the lanes which are below the number of
+ * groups their device may have verified at once, so a spinning disk serves
+ * one group at a time and a slow network filesystem does not hold up the
+ * workers while the groups on the other devices are waiting.  At most
+ * `max_total` groups are verified at once over all the lanes.
+ */
+class Lanes {
+public:
+  Lanes(FileTable &table, const IndexGroups &groups,
+        const std::vector<size_t> &order, size_t max_total)
+      : max_total{max_total} {
+    std::unordered_map<uint64_t, size_t> lane_of;
+    for (size_t k = 0; k < order.size(); ++k) {
+      FileTable::Index lead = groups[order.at(k)].front();
+      auto [it, inserted] = lane_of.emplace(table.dev(lead), lanes.size());
+      if (inserted)
+        lanes.emplace_back().max_active =
+            DeviceProfiles::get(table.dev(lead), table.path(lead).c_str())
+                .max_active;
+      lanes.at(it->second).groups.push_back(k);
+    }
+  }
+
+  /**
+   * @brief Take the next group to verify, if there is room for one.
+   *
+   * @param lane Set to the lane of the group, for done().
+   *
+   * @return The position of the group in the order, nothing when no lane with
+   * groups left has room.
+   */
+  std::optional<size_t> take(size_t &lane) {
+    const std::lock_guard<std::mutex> lock(mutex);
+    if (active >= max_total)
+      return std::nullopt;
+    std::optional<size_t> best;
+    for (size_t l = 0; l < lanes.size(); ++l) {
+      Lane &candidate = lanes.at(l);
+      if (candidate.next == candidate.groups.size() ||
+          (candidate.max_active != 0 &&
+           candidate.active >= candidate.max_active))
+        continue;
+      if (!best || candidate.groups.at(candidate.next) <
+                       lanes.at(*best).groups.at(lanes.at(*best).next))
+        best = l;
+    }
+    if (!best)
+      return std::nullopt;
+    lane = *best;
+    Lane &chosen = lanes.at(lane);
+    ++chosen.active;
+    ++active;
+    return chosen.groups.at(chosen.next++);
+  }
+
+  void done(size_t lane) {
+    const std::lock_guard<std::mutex> lock(mutex);
+    --lanes.at(lane).active;
+    --active;
+  }
+
+  // Whether the device of the lane takes reads from any number of workers, so
+  // that its groups may be split over them.
+  bool shared(size_t lane) const { return lanes.at(lane).max_active == 0; }
+
+private:
+  struct Lane {
+    // Positions in the order.
+    std::vector<size_t> groups;
+    size_t next{0};
+    size_t active{0};
+    size_t max_active{0};
+  };
+  std::vector<Lane> lanes;
+  size_t active{0};
+  const size_t max_total;
+  std::mutex mutex;
+};
+
+/**
+ * @brief Verifies the size groups on a pool.  Every group is a task, started
+ * when Lanes has room for it.  A group of more than `split_files` files on a
+ * shared device is spread over the pool instead: the heads of its files, the
+ * first round of xxhash_progressive, are hashed in slices of `grain` files, a
+ * task each, and its classes of equal heads are verified in tasks of at least
+ * `grain` files.  Every task hands its sets to the calling thread as soon as
+ * it is done, with a last message when its group is.
+ */
+class PoolVerifier {
+public:
+  PoolVerifier(FileTable &table, const IndexGroups &groups,
+               const std::vector<size_t> &order, ThreadPool &pool,
+               bool compare)
+      : table{table}, groups{groups}, order{order}, pool{pool},
+        compare{compare}, lanes{table, groups, order, pool.size()},
+        finished{4 * pool.size()} {}
+
+  /**
+   * @brief Verify every group, calling on_set from this thread with the sets
+   * in the order they are confirmed.
+   *
+   * @return The first exception a group threw, nothing if none did.
+   */
+  std::exception_ptr run(const Pipeline::SetCallback &on_set) {
+    dispatch();
+    for (size_t groups_done = 0; groups_done < groups.size();) {
+      Message message = finished.pop();
+      for (size_t i = 0; i < message.sets.size(); ++i)
+        on_set(message.sets[i]);
+      if (message.group_done)
+        ++groups_done;
+    }
+    pool.wait();
+    return error;
+  }
+
+private:
+  static constexpr size_t split_files = 1024;
+  static constexpr size_t grain = 256;
+
+  struct Message {
+    IndexGroups sets;
+    bool group_done{false};
+  };
+
+  // A group spread over the pool, shared by its tasks.
+  struct Split {
+    std::span<const FileTable::Index> group;
+    size_t lane{0};
+    // The tasks of the current step still running.
+    std::atomic<size_t> left{0};
+  };
+
+  FileTable &table;
+  const IndexGroups &groups;
+  const std::vector<size_t> &order;
+  ThreadPool &pool;
+  const bool compare;
+  Lanes lanes;
+  BoundedQueue<Message> finished;
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  // Start the groups Lanes has room for.
+  void dispatch() {
+    size_t lane{0};
+    for (std::optional<size_t> k; (k = lanes.take(lane));)
+      pool.submit([this, g = order.at(*k), lane]() { start(g, lane); });
+  }
+
+  // Run `work`, keeping the first exception for the end of the run.
+  template <class Work> void guarded(Work work) {
+    try {
+      work();
+    } catch (...) {
+      const std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error)
+        error = std::current_exception();
+    }
+  }
+
+  void group_done(size_t lane, IndexGroups sets = {}) {
+    finished.push(Message{std::move(sets), true});
+    lanes.done(lane);
+    dispatch();
+  }
+
+  void start(size_t g, size_t lane) {
+    std::span<const FileTable::Index> group = groups[g];
+    if (group.size() <= split_files || !lanes.shared(lane)) {
+      IndexGroups sets;
+      guarded([&]() { verify_group(table, group, compare, sets); });
+      group_done(lane, std::move(sets));
+      return;
+    }
+    auto split = std::make_shared<Split>();
+    split->group = group;
+    split->lane = lane;
+    std::vector<FileTable::Index> missing;
+    for (FileTable::Index f : group)
+      if (!table.has_head(f))
+        missing.push_back(f);
+    if (missing.empty()) {
+      verify_classes(split);
+      return;
+    }
+    size_t slices = (missing.size() + grain - 1) / grain;
+    split->left = slices;
+    for (size_t s = 0; s < slices; ++s) {
+      std::vector<FileTable::Index> slice(
+          missing.begin() + s * grain,
+          missing.begin() + std::min(missing.size(), (s + 1) * grain));
+      pool.submit([this, split, slice = std::move(slice)]() {
+        guarded([&]() { hash_heads(slice); });
+        if (--split->left == 0)
+          verify_classes(split);
+      });
+    }
+  }
+
+  void hash_heads(const std::vector<FileTable::Index> &slice) {
+    IOStats::PhaseScope phase{IOStats::Phase::hash};
+    std::vector<std::string> paths;
+    for (FileTable::Index f : slice)
+      paths.push_back(table.path(f));
+    FiltersList::HashVector heads = FiltersList::xxhash_heads(paths);
+    for (size_t i = 0; i < slice.size(); ++i)
+      if (heads.at(i))
+        table.set_head(slice.at(i), *heads.at(i));
+  }
+
+  // Split the group by the heads of its files and verify the classes of more
+  // than one file, a few at a time.  The files whose head could not be read
+  // are dropped.
+  void verify_classes(const std::shared_ptr<Split> &split) {
+    std::vector<IndexGroups> batches;
+    guarded([&]() {
+      std::vector<FileTable::Index> hashed;
+      for (FileTable::Index f : split->group)
+        if (table.has_head(f))
+          hashed.push_back(f);
+      FlatIndexMap<Hash128> index{hashed.size()};
+      std::vector<uint32_t> class_of;
+      for (FileTable::Index f : hashed)
+        class_of.push_back(index.insert(table.head(f)).first);
+      IndexGroups classes;
+      add_classes(hashed, class_of, index.size(), classes);
+      for (size_t c = 0; c < classes.size(); ++c) {
+        if (batches.empty() || batches.back().num_indices() >= grain)
+          batches.emplace_back();
+        batches.back().add(classes[c]);
+      }
+    });
+    if (batches.empty()) {
+      group_done(split->lane);
+      return;
+    }
+    split->left = batches.size();
+    for (auto &batch : batches)
+      pool.submit([this, split, batch = std::move(batch)]() {
+        Message message;
+        guarded([&]() {
+          for (size_t c = 0; c < batch.size(); ++c)
+            verify_group(table, batch[c], compare, message.sets);
+        });
+        finished.push(std::move(message));
+        if (--split->left == 0)
+          group_done(split->lane);
+      });
+  }
+};
+} // namespace
+
+/**
+ * @brief Find the sets of duplicates in the size groups.
+ *
+ * @param table The files.  The full hashes of the duplicates are kept in it.
+ * If it has read keys, the groups are verified in ReadOrder of their first
+ * file, and the files of a group are read in ReadOrder.  The groups are put
+ * in a lane for the device of their first file, see Lanes, and the large ones
+ * are spread over the pool, see PoolVerifier.
+ * @param groups The size groups.
+ * @param pool The pool the groups are verified on, nullptr to verify them
+ * here.
+ * @param compare Whether to compare the files byte by byte after hashing.
+ * @param on_set Called with every set of duplicates as soon as it is
+ * confirmed: in the order the groups are verified without a pool, and in the
+ * order the workers finish with them with one.  If a group could not be
+ * verified, the sets of the other groups are still passed on and the first
+ * exception is rethrown at the end.
+ */
+void Pipeline::run(FileTable &table, const IndexGroups &groups,
+                   ThreadPool *pool, bool compare, const SetCallback &on_set) {
+  std::vector<size_t> order(groups.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (table.has_read_keys()) {
+    std::vector<FileTable::Index> lead(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g)
+      lead.at(g) = *std::min_element(
+          groups[g].begin(), groups[g].end(),
+          [&table](FileTable::Index a, FileTable::Index b) {
+            return ReadOrder::before(table, a, b);
+          });
+    std::stable_sort(order.begin(), order.end(),
+                     [&table, &lead](size_t a, size_t b) {
+                       return ReadOrder::before(table, lead.at(a), lead.at(b));
+                     });
+  }
+
+  std::exception_ptr first_error;
+  if (pool == nullptr) {
+    IndexGroups sets;
+    for (size_t g : order) {
+      sets = IndexGroups{};
+      try {
+        verify_group(table, groups[g], compare, sets);
+      } catch (...) {
+        if (!first_error)
+          first_error = std::current_exception();
+      }
+      for (size_t i = 0; i < sets.size(); ++i)
+        on_set(sets[i]);
+    }
+  } else {
+    PoolVerifier verifier{table, groups, order, *pool, compare};
+    first_error = verifier.run(on_set);
+  }
+  if (first_error)
+    std::rethrow_exception(first_error);
+}
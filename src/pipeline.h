@@ -0,0 +1,45 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <functional> // for function
+#include <span>       // for span
+
+#include "file_table.h"  // for FileTable, IndexGroups
+#include "thread_pool.h" // for ThreadPool
+
+/**
+ * @brief The stages after the size grouping, run one size group at a time.
+ * Every group is hashed by growing prefixes and its classes are compared byte
+ * by byte, so a group is confirmed as soon as its own files are read, whatever
+ * the state of the other groups.  The groups are put in a lane for the device
+ * of their first file, in order or in ReadOrder when the table has read keys.
+ * A worker takes the earliest group of the lanes whose device has room for
+ * one more group, and a large group on a device which takes any number of
+ * readers is spread over the pool, its heads hashed in slices and its classes
+ * of equal heads verified apart.  The calling thread passes every set on as
+ * soon as it is confirmed, so no set waits for another group; with a pool the
+ * sets come out in the order the workers finish them.
+ */
+namespace Pipeline {
+using SetCallback = std::function<void(std::span<const FileTable::Index>)>;
+
+void run(FileTable &table, const IndexGroups &groups, ThreadPool *pool,
+         bool compare, const SetCallback &on_set);
+} // namespace Pipeline
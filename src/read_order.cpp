@@ -0,0 +1,135 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "read_order.h"
+
+#include <fcntl.h>        // for open, O_RDONLY, O_CLOEXEC
+#include <linux/fiemap.h> // for fiemap, fiemap_extent
+#include <linux/fs.h>     // for FS_IOC_FIEMAP
+#include <stddef.h>       // for size_t
+#include <sys/ioctl.h>    // for ioctl
+#include <unistd.h>       // for close
+
+#include <algorithm> // for sort, min
+#include <numeric>   // for iota
+#include <tuple>     // for make_tuple
+
+#include "io_stats.h" // for IOStats
+
+namespace {
+constexpr size_t grain = 256;
+} // namespace
+
+/**
+ * @brief The physical offset of the first extent of a file.
+ *
+ * @param path The file.
+ *
+ * @return The offset, nothing if the file cannot be opened or its filesystem
+ * does not map its extents.
+ */
+std::optional<uint64_t> ReadOrder::first_extent(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::nullopt;
+  IOStats::count_open();
+  // Room for the header and the one extent asked for.
+  alignas(struct fiemap) unsigned char
+      buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)]{};
+  auto *map = reinterpret_cast<struct fiemap *>(buffer);
+  map->fm_start = 0;
+  map->fm_length = FIEMAP_MAX_OFFSET;
+  map->fm_extent_count = 1;
+  int r = ioctl(fd, FS_IOC_FIEMAP, map);
+  close(fd);
+  if (r != 0 || map->fm_mapped_extents == 0 ||
+      (map->fm_extents[0].fe_flags &
+       (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE)) != 0)
+    return std::nullopt;
+  return map->fm_extents[0].fe_physical;
+}
+
+/**
+ * @brief Look up where the files of the groups lie, for before() and ranks().
+ * The files are visited in inode order, which is the order their metadata is
+ * laid out in on most filesystems.
+ *
+ * @param table The files.  Gets the keys.
+ * @param groups The files to place.
+ * @param pool The pool the lookups are spread over, nullptr to do them here.
+ */
+void ReadOrder::assign_keys(FileTable &table, const IndexGroups &groups,
+                            ThreadPool *pool) {
+  std::vector<FileTable::Index> files;
+  for (size_t g = 0; g < groups.size(); ++g)
+    files.insert(files.end(), groups[g].begin(), groups[g].end());
+  std::sort(files.begin(), files.end(),
+            [&table](FileTable::Index a, FileTable::Index b) {
+              return std::make_tuple(table.dev(a), table.ino(a)) <
+                     std::make_tuple(table.dev(b), table.ino(b));
+            });
+  table.init_read_keys();
+  for (size_t begin = 0; begin < files.size(); begin += grain) {
+    size_t end = std::min(begin + grain, files.size());
+    auto task = [&table, &files, begin, end]() {
+      for (size_t j = begin; j < end; ++j) {
+        FileTable::Index f = files.at(j);
+        table.set_read_key(
+            f, first_extent(table.path(f).c_str()).value_or(unknown));
+      }
+    };
+    if (pool == nullptr)
+      task();
+    else
+      pool->submit(task);
+  }
+  if (pool != nullptr)
+    pool->wait();
+}
+
+/**
+ * @brief Whether file a is to be read before file b: by device, then by the
+ * offset of the first extent, then by inode.
+ */
+bool ReadOrder::before(const FileTable &table, FileTable::Index a,
+                       FileTable::Index b) {
+  return std::make_tuple(table.dev(a), table.read_key(a), table.ino(a)) <
+         std::make_tuple(table.dev(b), table.read_key(b), table.ino(b));
+}
+
+/**
+ * @brief The position of every file of a group in read order.
+ *
+ * @param table The files, with their keys assigned.
+ * @param group The files.
+ *
+ * @return The rank of each file, in group order.
+ */
+std::vector<size_t> ReadOrder::ranks(const FileTable &table,
+                                     std::span<const FileTable::Index> group) {
+  std::vector<size_t> order(group.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&table, group](size_t a, size_t b) {
+    return before(table, group[a], group[b]);
+  });
+  std::vector<size_t> rank(group.size());
+  for (size_t r = 0; r < order.size(); ++r)
+    rank.at(order.at(r)) = r;
+  return rank;
+}
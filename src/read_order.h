@@ -0,0 +1,48 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stdint.h> // for uint64_t
+
+#include <optional> // for optional
+#include <span>     // for span
+#include <vector>   // for vector
+
+#include "file_table.h"  // for FileTable, IndexGroups
+#include "thread_pool.h" // for ThreadPool
+
+/**
+ * @brief Orders the reads of the hashing and comparison stages by where the
+ * files lie on their devices, so a spinning disk is swept instead of sought
+ * all over.  A file is placed by the physical offset of its first extent, from
+ * FIEMAP, and files whose extents are not known (tmpfs, NFS, empty or inline
+ * files) come after them in inode order.  Only the order of the reads changes,
+ * never the groups or the order they are reported in.
+ */
+namespace ReadOrder {
+// The key of a file whose first extent is not known.
+constexpr uint64_t unknown = UINT64_MAX;
+
+std::optional<uint64_t> first_extent(const char *path);
+void assign_keys(FileTable &table, const IndexGroups &groups,
+                 ThreadPool *pool = nullptr);
+bool before(const FileTable &table, FileTable::Index a, FileTable::Index b);
+std::vector<size_t> ranks(const FileTable &table,
+                          std::span<const FileTable::Index> group);
+} // namespace ReadOrder
@@ -0,0 +1,77 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "sparse.h"
+
+#include <errno.h>  // for errno, ENXIO
+#include <unistd.h> // for lseek, SEEK_DATA, SEEK_HOLE
+
+const unsigned char Sparse::zeros[Sparse::zeros_size] = {};
+
+Sparse::Extents::Extents(int _fd) : fd{_fd} {
+  struct stat st;
+  if (fstat(fd, &st) == 0)
+    *this = Extents{fd, st};
+}
+
+Sparse::Extents::Extents(int _fd, const struct stat &st)
+    : fd{_fd}, size{static_cast<uint64_t>(st.st_size)},
+      has_holes{static_cast<uint64_t>(st.st_blocks) * 512 < size} {}
+
+/**
+ * @brief The length of the hole at an offset.
+ *
+ * @param offset The offset the file is read at.
+ * @param end The offset reading stops at, holes are cut short there and at
+ * the end of the file.
+ *
+ * @return The bytes up to the next data or to `end`, 0 when there is data at
+ * the offset or the filesystem cannot tell.
+ */
+uint64_t Sparse::Extents::hole(uint64_t offset, uint64_t end) {
+  if (!has_holes || offset >= end ||
+      (offset >= data_start && offset < data_stop))
+    return 0;
+  off_t data = lseek(fd, static_cast<off_t>(offset), SEEK_DATA);
+  if (data < 0) {
+    // No data after the offset, the rest of the file is a hole.
+    if (errno == ENXIO)
+      return std::max(std::min(end, size), offset) - offset;
+    has_holes = false;
+    return 0;
+  }
+  if (static_cast<uint64_t>(data) > offset)
+    return std::min(static_cast<uint64_t>(data), end) - offset;
+  off_t hole = lseek(fd, static_cast<off_t>(offset), SEEK_HOLE);
+  data_start = offset;
+  data_stop = hole < 0 ? UINT64_MAX : static_cast<uint64_t>(hole);
+  return 0;
+}
+
+/**
+ * @brief Where the data at an offset ends, after hole() found data there.
+ * Reads cut short there leave the hole behind it for hole() to skip.
+ *
+ * @return The offset of the next hole, UINT64_MAX if it is not known.
+ */
+uint64_t Sparse::Extents::data_end(uint64_t offset) const {
+  if (!has_holes || offset < data_start || offset >= data_stop)
+    return UINT64_MAX;
+  return data_stop;
+}
@@ -0,0 +1,75 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uint64_t, UINT64_MAX
+#include <sys/stat.h> // for stat
+
+#include <algorithm> // for min
+
+/**
+ * @brief Reading sparse files without reading their holes.  The data extents
+ * of a file are found with SEEK_DATA and SEEK_HOLE, and the holes are handed
+ * on as runs of zeros, which is what reading them would give, so the hashes
+ * and comparisons come out the same as for a dense file with the same
+ * content.  Only the allocated blocks are read.
+ */
+namespace Sparse {
+// Handed out for holes, a run at a time.
+constexpr size_t zeros_size = 1 << 20;
+extern const unsigned char zeros[zeros_size];
+
+/**
+ * @brief Call `callback(data, size)` with `length` zeros.
+ */
+template <typename Callback>
+void feed_zeros(uint64_t length, const Callback &callback) {
+  while (length > 0) {
+    size_t size = static_cast<size_t>(std::min<uint64_t>(length, zeros_size));
+    callback(zeros, size);
+    length -= size;
+  }
+}
+
+/**
+ * @brief The holes and data extents of an open file, looked up as it is read
+ * front to back.  A file with as many blocks as its size has no holes and is
+ * never looked at.  Moves the file position, so the file is to be read with
+ * pread() or mmap().
+ */
+class Extents {
+public:
+  Extents() = default;
+  explicit Extents(int fd);
+  Extents(int fd, const struct stat &st);
+
+  uint64_t hole(uint64_t offset, uint64_t end);
+  uint64_t data_end(uint64_t offset) const;
+  bool sparse() const { return has_holes; }
+
+private:
+  int fd{-1};
+  uint64_t size{0};
+  bool has_holes{false};
+  // The data extent found last.
+  uint64_t data_start{0};
+  uint64_t data_stop{0};
+};
+} // namespace Sparse
@@ -0,0 +1,144 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "stats_report.h"
+
+#include <sys/resource.h> // for getrusage, RUSAGE_SELF
+
+#include <fstream>           // for ofstream
+#include <nlohmann/json.hpp> // for json
+#include <stdexcept>         // for runtime_error
+#include <utility>           // for pair
+
+#include "fmt/core.h" // for format
+
+namespace {
+/**
+ * @brief The user and system time of all the threads of the process.
+ */
+double cpu_ms() {
+  struct rusage usage {};
+  getrusage(RUSAGE_SELF, &usage);
+  auto ms = [](const struct timeval &t) {
+    return static_cast<double>(t.tv_sec) * 1e3 +
+           static_cast<double>(t.tv_usec) / 1e3;
+  };
+  return ms(usage.ru_utime) + ms(usage.ru_stime);
+}
+} // namespace
+
+/**
+ * @brief Start measuring a stage.
+ *
+ * @param name The name of the stage.
+ * @param table The files.
+ * @param groups_in The groups the stage starts from.
+ */
+void StatsReport::start(const std::string &name, const FileTable &table,
+                        const IndexGroups &groups_in) {
+  current = Stage{};
+  current.name = name;
+  current.files_in = groups_in.num_indices();
+  current.groups_in = groups_in.size();
+  for (size_t g = 0; g < groups_in.size(); ++g)
+    for (FileTable::Index i : groups_in[g])
+      current.bytes_in += table.file_size(i);
+  io_start = IOStats::snapshot();
+  hash_io_start = IOStats::snapshot(IOStats::Phase::hash);
+  compare_io_start = IOStats::snapshot(IOStats::Phase::compare);
+  cpu_start_ms = cpu_ms();
+  wall_start = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Finish measuring the stage last started.
+ *
+ * @param groups_out The groups the stage came up with.
+ */
+void StatsReport::stop(const IndexGroups &groups_out) {
+  current.wall_ms = std::chrono::duration<double, std::milli>{
+      std::chrono::steady_clock::now() - wall_start}
+                        .count();
+  current.cpu_ms = cpu_ms() - cpu_start_ms;
+  current.io = IOStats::snapshot() - io_start;
+  current.hash_io = IOStats::snapshot(IOStats::Phase::hash) - hash_io_start;
+  current.compare_io =
+      IOStats::snapshot(IOStats::Phase::compare) - compare_io_start;
+  current.files_out = groups_out.num_indices();
+  current.groups_out = groups_out.size();
+  done.push_back(current);
+}
+
+namespace {
+nlohmann::json io_json(const IOStats::Counters &io) {
+  return {{"bytes_read", io.bytes_read},
+          {"opens", io.opens},
+          {"reads", io.reads},
+          {"cache_hits", io.cache_hits},
+          {"cache_misses", io.cache_misses}};
+}
+} // namespace
+
+/**
+ * @brief The stages as a JSON document.  read_amplification is the number of
+ * bytes read over the total size of the files which went in.  A stage which
+ * hashed or compared files also has the I/O of each of those phases.
+ */
+std::string StatsReport::to_json() const {
+  nlohmann::json stages = nlohmann::json::array();
+  for (const Stage &stage : done) {
+    stages.push_back(
+        {{"name", stage.name},
+         {"wall_ms", stage.wall_ms},
+         {"cpu_ms", stage.cpu_ms},
+         {"files_in", stage.files_in},
+         {"files_out", stage.files_out},
+         {"groups_in", stage.groups_in},
+         {"groups_out", stage.groups_out},
+         {"bytes_in", stage.bytes_in},
+         {"bytes_read", stage.io.bytes_read},
+         {"read_amplification",
+          stage.bytes_in == 0 ? 0.0
+                              : static_cast<double>(stage.io.bytes_read) /
+                                    static_cast<double>(stage.bytes_in)},
+         {"opens", stage.io.opens},
+         {"reads", stage.io.reads},
+         {"cache_hits", stage.io.cache_hits},
+         {"cache_misses", stage.io.cache_misses}});
+    for (const auto &[name, io] : {std::pair{"hash", stage.hash_io},
+                                   std::pair{"compare", stage.compare_io}})
+      if (io.opens != 0 || io.reads != 0 || io.cache_hits != 0 ||
+          io.cache_misses != 0)
+        stages.back()["phases"][name] = io_json(io);
+  }
+  return nlohmann::json{{"stages", stages}}.dump(4);
+}
+
+/**
+ * @brief Write the JSON document to a file.  Throws a runtime_error if it
+ * cannot be written.
+ *
+ * @param path The file.
+ */
+void StatsReport::write(const std::string &path) const {
+  std::ofstream out{path};
+  out << to_json() << std::endl;
+  if (!out)
+    throw std::runtime_error(fmt::format("Cannot write stats: {}", path));
+}
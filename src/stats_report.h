@@ -0,0 +1,65 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <chrono> // for steady_clock
+#include <string> // for string
+#include <vector> // for vector
+
+#include "file_table.h" // for FileTable, IndexGroups
+#include "io_stats.h"   // for IOStats::Counters
+
+/**
+ * @brief Measures the stages of the pipeline one after the other, for --stats.
+ * A stage runs from start() to stop().  For every stage it records the wall
+ * and CPU time of the process, the files and groups which went in and came
+ * out, and the I/O counted by IOStats in between.
+ */
+class StatsReport {
+public:
+  struct Stage {
+    std::string name;
+    double wall_ms{0};
+    double cpu_ms{0};
+    size_t files_in{0}, files_out{0};
+    size_t groups_in{0}, groups_out{0};
+    // The total size of the files which went in.
+    uint64_t bytes_in{0};
+    IOStats::Counters io;
+    // The part of io done in the hash and compare phases.
+    IOStats::Counters hash_io, compare_io;
+  };
+
+  void start(const std::string &name, const FileTable &table,
+             const IndexGroups &groups_in);
+  void stop(const IndexGroups &groups_out);
+  const std::vector<Stage> &stages() const { return done; }
+  std::string to_json() const;
+  void write(const std::string &path) const;
+
+private:
+  std::vector<Stage> done;
+  Stage current;
+  std::chrono::steady_clock::time_point wall_start;
+  double cpu_start_ms{0};
+  IOStats::Counters io_start, hash_io_start, compare_io_start;
+};
@@ -0,0 +1,167 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "thread_pool.h"
+
+#include <utility> // for move
+
+namespace {
+thread_local const ThreadPool *current_pool{nullptr};
+thread_local size_t current_worker{0};
+} // namespace
+
+/**
+ * @brief Start the workers.
+ *
+ * @param num_threads The number of workers, at least one is started.
+ */
+ThreadPool::ThreadPool(size_t num_threads) {
+  if (num_threads == 0)
+    num_threads = 1;
+  for (size_t i = 0; i < num_threads; ++i)
+    queues.emplace_back(std::make_unique<Worker>());
+  for (size_t i = 0; i < num_threads; ++i)
+    workers.emplace_back([this, i]() { run(i); });
+}
+
+/**
+ * @brief Stop the workers once the queued tasks have run.
+ */
+ThreadPool::~ThreadPool() {
+  {
+    const std::lock_guard<std::mutex> lock(state_mutex);
+    stopping = true;
+  }
+  work_available.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+/**
+ * @brief Queue a task.  From inside a worker the task goes to that worker's
+ * own deque, otherwise the deques are filled round robin.
+ *
+ * @param task The task to run.
+ */
+void ThreadPool::submit(Task task) {
+  size_t id = current_pool == this
+                  ? current_worker
+                  : next_queue.fetch_add(1) % queues.size();
+  {
+    const std::lock_guard<std::mutex> lock(state_mutex);
+    {
+      const std::lock_guard<std::mutex> queue_lock(queues.at(id)->mutex);
+      queues.at(id)->tasks.emplace_back(std::move(task));
+    }
+    ++pending;
+    ++queued;
+  }
+  work_available.notify_one();
+}
+
+/**
+ * @brief Block until every submitted task has finished.  Must not be called
+ * from inside a worker.
+ *
+ * @throw The first exception thrown by a task since the last wait().
+ */
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(state_mutex);
+  all_done.wait(lock, [this]() { return pending == 0; });
+  if (first_exception) {
+    std::exception_ptr exp = first_exception;
+    first_exception = nullptr;
+    std::rethrow_exception(exp);
+  }
+}
+
+/**
+ * @brief Take a task from the back of our own deque or steal one from the
+ * front of another worker's deque.
+ *
+ * @param id The index of the worker looking for work.
+ * @param task The task taken, if any.
+ *
+ * @return true if a task was taken and false otherwise.
+ */
+bool ThreadPool::pop_or_steal(size_t id, Task &task) {
+  {
+    Worker &own = *queues.at(id);
+    const std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); ++i) {
+    Worker &victim = *queues.at((id + i) % queues.size());
+    const std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief The worker loop.
+ *
+ * @param id The index of this worker's deque.
+ */
+void ThreadPool::run(size_t id) {
+  current_pool = this;
+  current_worker = id;
+  while (true) {
+    Task task;
+    if (pop_or_steal(id, task)) {
+      {
+        const std::lock_guard<std::mutex> lock(state_mutex);
+        --queued;
+      }
+      std::exception_ptr exp;
+      try {
+        task();
+      } catch (...) {
+        exp = std::current_exception();
+      }
+      finish_task(exp);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(state_mutex);
+    work_available.wait(lock, [this]() { return stopping || queued > 0; });
+    if (stopping && queued == 0)
+      return;
+  }
+}
+
+/**
+ * @brief Book-keeping after a task has run.
+ *
+ * @param exp The exception thrown by the task, if any.
+ */
+void ThreadPool::finish_task(std::exception_ptr exp) {
+  const std::lock_guard<std::mutex> lock(state_mutex);
+  if (exp && !first_exception)
+    first_exception = exp;
+  if (--pending == 0)
+    all_done.notify_all();
+}
@@ -0,0 +1,72 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+
+#include <atomic>             // for atomic
+#include <condition_variable> // for condition_variable
+#include <deque>              // for deque
+#include <exception>          // for exception_ptr
+#include <functional>         // for function
+#include <memory>             // for unique_ptr
+#include <mutex>              // for mutex
+#include <thread>             // for thread
+#include <vector>             // for vector
+
+/**
+ * @brief A work-stealing thread pool.  Every worker owns a deque of tasks, it
+ * pops work from the back of its own deque and, when that runs dry, steals
+ * from the front of the other workers' deques.  Tasks submitted from inside a
+ * worker land on that worker's deque, so a task that splits itself keeps the
+ * pieces local unless some other worker is idle.
+ */
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+  explicit ThreadPool(size_t num_threads);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(Task task);
+  void wait();
+  size_t size() const { return workers.size(); }
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex state_mutex;
+  std::condition_variable work_available, all_done;
+  size_t pending{0}, queued{0};
+  bool stopping{false};
+  std::exception_ptr first_exception;
+  std::atomic<size_t> next_queue{0};
+
+  void run(size_t id);
+  bool pop_or_steal(size_t id, Task &task);
+  void finish_task(std::exception_ptr exp);
+};
@@ -0,0 +1,237 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "throttle.h"
+
+#include <sched.h>       // for sched_setscheduler, SCHED_IDLE
+#include <signal.h>      // for sigaction, SIGHUP
+#include <sys/syscall.h> // for SYS_ioprio_set
+#include <unistd.h>      // for syscall
+
+#include <algorithm>    // for min, max
+#include <cctype>       // for isdigit
+#include <atomic>       // for atomic
+#include <cerrno>       // for errno
+#include <chrono>       // for steady_clock, duration
+#include <fstream>      // for ifstream
+#include <mutex>        // for mutex, lock_guard
+#include <stdexcept>    // for runtime_error
+#include <system_error> // for error_code, system_category
+#include <thread>       // for sleep_for
+
+#include "debug.h" // for warn
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using Seconds = std::chrono::duration<double>;
+
+// The longest a thread sleeps before looking at the limits again, so a limit
+// raised while it waits soon lets it go.
+constexpr Seconds max_sleep{0.1};
+
+/**
+ * @brief Tokens which fill up at a rate and hold a second's worth, and which
+ * may be taken into debt.
+ */
+struct Bucket {
+  double rate{0};
+  double tokens{0};
+  Clock::time_point last{Clock::now()};
+
+  void reset(uint64_t new_rate) {
+    rate = static_cast<double>(new_rate);
+    tokens = 0;
+    last = Clock::now();
+  }
+
+  // The time until the bucket is out of debt, zero when it is.
+  Seconds wait(Clock::time_point now) {
+    if (rate == 0)
+      return Seconds{0};
+    tokens = std::min(rate, tokens + rate * Seconds{now - last}.count());
+    last = now;
+    return Seconds{tokens >= 0 ? 0 : -tokens / rate};
+  }
+};
+
+std::mutex buckets_mutex;
+Bucket bytes_bucket, reads_bucket;
+Throttle::Limits current;
+std::atomic<bool> enabled{false};
+
+std::string control_path;
+std::atomic<bool> reload{false};
+static_assert(std::atomic<bool>::is_always_lock_free);
+
+void on_sighup(int) { reload.store(true, std::memory_order_relaxed); }
+
+/**
+ * @brief Set the limits from the control file, keeping them as they are if it
+ * cannot be read or parsed.
+ */
+void read_control_file() {
+  std::ifstream in{control_path};
+  if (!in) {
+    spdlog::warn("Cannot read the control file: {}", control_path);
+    return;
+  }
+  try {
+    Throttle::set_limits(Throttle::parse_limits(in, Throttle::limits()));
+  } catch (std::runtime_error &exp) {
+    spdlog::warn("{} in the control file: {}", exp.what(), control_path);
+  }
+}
+
+/**
+ * @brief Read the control file if SIGHUP came since the last time.
+ */
+void reload_if_asked() {
+  if (reload.load(std::memory_order_relaxed) &&
+      reload.exchange(false, std::memory_order_relaxed))
+    read_control_file();
+}
+} // namespace
+
+/**
+ * @brief Set the limits.  The buckets start empty.
+ */
+void Throttle::set_limits(const Limits &limits) {
+  const std::lock_guard<std::mutex> lock(buckets_mutex);
+  current = limits;
+  bytes_bucket.reset(limits.read_rate);
+  reads_bucket.reset(limits.iops);
+  enabled.store(limits.read_rate != 0 || limits.iops != 0,
+                std::memory_order_relaxed);
+}
+
+Throttle::Limits Throttle::limits() {
+  const std::lock_guard<std::mutex> lock(buckets_mutex);
+  return current;
+}
+
+/**
+ * @brief Count a read towards the limits.  The calling thread waits until the
+ * reads before it are paid for, and then takes the tokens of this one, so
+ * the reads of all threads together keep to the limits.
+ *
+ * @param bytes The bytes read.
+ */
+void Throttle::account(size_t bytes) {
+  reload_if_asked();
+  if (!enabled.load(std::memory_order_relaxed))
+    return;
+  std::unique_lock<std::mutex> lock(buckets_mutex);
+  while (true) {
+    Clock::time_point now = Clock::now();
+    Seconds wait = std::max(bytes_bucket.wait(now), reads_bucket.wait(now));
+    if (wait <= Seconds{0})
+      break;
+    lock.unlock();
+    std::this_thread::sleep_for(std::min(wait, max_sleep));
+    // New limits apply to the reads already waiting.
+    reload_if_asked();
+    if (!enabled.load(std::memory_order_relaxed))
+      return;
+    lock.lock();
+  }
+  bytes_bucket.tokens -= static_cast<double>(bytes);
+  reads_bucket.tokens -= 1;
+}
+
+/**
+ * @brief Parse limits, one `name=value` a line, such as `max-read-rate=1048576`
+ * or `max-iops=100`.  Blank lines and lines starting with # are skipped.
+ *
+ * @param in The lines.
+ * @param limits The limits which are not given.
+ *
+ * @return The limits, and a runtime_error for a line which is not one.
+ */
+Throttle::Limits Throttle::parse_limits(std::istream &in, Limits limits) {
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line.front() == '#')
+      continue;
+    size_t equals = line.find('=');
+    std::string name = line.substr(0, equals);
+    uint64_t *limit = name == "max-read-rate" ? &limits.read_rate
+                      : name == "max-iops"    ? &limits.iops
+                                              : nullptr;
+    if (equals == std::string::npos || limit == nullptr)
+      throw std::runtime_error(fmt::format("Unknown limit: {}", line));
+    std::string value = line.substr(equals + 1);
+    size_t end = 0;
+    try {
+      if (!value.empty() && std::isdigit(static_cast<unsigned char>(value[0])))
+        *limit = std::stoull(value, &end);
+    } catch (std::out_of_range &) {
+      end = 0;
+    }
+    if (end == 0 || end != value.size())
+      throw std::runtime_error(fmt::format("Bad limit: {}", line));
+  }
+  return limits;
+}
+
+/**
+ * @brief Take the limits from a control file now, if it exists, and again
+ * every time the process gets SIGHUP.
+ *
+ * @param control_file The file.
+ */
+void Throttle::watch(const std::string &control_file) {
+  control_path = control_file;
+  std::ifstream in{control_path};
+  if (in)
+    read_control_file();
+  struct sigaction action{};
+  action.sa_handler = on_sighup;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &action, nullptr);
+}
+
+/**
+ * @brief Run the calling thread, and the threads it starts afterwards, in the
+ * idle CPU scheduling class and the idle I/O priority class, so they only get
+ * the CPU and the disks when nothing else wants them.
+ *
+ * @return Whether both were set, a warning is logged for the ones which were
+ * not.
+ */
+bool Throttle::enter_idle() {
+  bool ok = true;
+  sched_param param{};
+  if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) {
+    spdlog::warn("Cannot set the idle scheduling class: {}",
+                 std::error_code{errno, std::system_category()}.message());
+    ok = false;
+  }
+  // From linux/ioprio.h, which older distributions do not ship.
+  constexpr int ioprio_who_process = 1;
+  constexpr int ioprio_class_idle = 3;
+  constexpr int ioprio_class_shift = 13;
+  if (syscall(SYS_ioprio_set, ioprio_who_process, 0,
+              ioprio_class_idle << ioprio_class_shift) != 0) {
+    spdlog::warn("Cannot set the idle I/O priority class: {}",
+                 std::error_code{errno, std::system_category()}.message());
+    ok = false;
+  }
+  return ok;
+}
@@ -0,0 +1,52 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <istream> // for istream
+#include <string>  // for string
+
+/**
+ * @brief Process wide limits on the reads done to find the duplicates, so a
+ * scan of a live server leaves its disks to the other work on it.  Every read
+ * takes tokens from a bucket for the bytes and one for the reads, which fill
+ * up at the limits set and hold at most a second's worth.  A thread finding a
+ * bucket in debt sleeps until it is paid off.
+ *
+ * The limits are read again from the control file on SIGHUP.
+ */
+namespace Throttle {
+struct Limits {
+  // Bytes per second, 0 for no limit.
+  uint64_t read_rate{0};
+  // Reads per second, 0 for no limit.
+  uint64_t iops{0};
+
+  bool operator==(const Limits &other) const = default;
+};
+
+void set_limits(const Limits &limits);
+Limits limits();
+void account(size_t bytes);
+Limits parse_limits(std::istream &in, Limits limits);
+void watch(const std::string &control_file);
+bool enter_idle();
+} // namespace Throttle
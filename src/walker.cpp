@@ -0,0 +1,318 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "walker.h"
+
+#include <dirent.h>      // for DT_DIR, DT_REG, DT_LNK, DT_UNKNOWN
+#include <errno.h>       // for errno, EINTR
+#include <fcntl.h>       // for openat, O_DIRECTORY, AT_SYMLINK_NOFOLLOW
+#include <string.h>      // for strcmp, strerror
+#include <sys/stat.h>    // for S_ISDIR, S_ISREG, S_ISLNK
+#include <sys/syscall.h> // for SYS_getdents64
+#include <unistd.h>      // for close, syscall
+
+#include <algorithm> // for sort
+#include <atomic>    // for atomic
+#include <memory>    // for unique_ptr
+#include <mutex>     // for mutex, lock_guard
+#include <optional>  // for optional
+#include <utility>   // for move
+
+#include "debug.h" // for warn
+
+namespace {
+// The layout getdents64() fills the buffer with.
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+constexpr size_t dirents_size = 64 * (1 << 10);
+// Subdirectories are opened relative to their parent while fewer than this
+// many directory fds are held, and by their full path beyond.
+constexpr int max_open_dirs = 256;
+
+struct Entry {
+  std::string name;
+  FileType file_type;
+  FileStat file_stat;
+};
+
+/**
+ * @brief A directory of the walk.  Its task fills in its files and creates
+ * its subdirectories, both sorted by name, before the subdirectories are
+ * walked, so the tree is read back in the same order whatever the scheduling.
+ */
+struct Dir {
+  std::string path;
+  int fd{-1};
+  std::vector<Entry> files;
+  std::vector<std::unique_ptr<Dir>> subdirs;
+  // Set, under the flush mutex, once files and subdirs are filled in.
+  bool done{false};
+};
+
+class Walk {
+public:
+  Walk(const WalkOptions &_options, ThreadPool *_pool, uint64_t _root_dev,
+       Dir &root, FileTable &_table, std::vector<FileTable::Index> &_group)
+      : options{_options}, pool{_pool}, root_dev{_root_dev}, table{_table},
+        group{_group} {
+    pending.push_back(Frame{&root});
+  }
+
+  void visit(Dir &dir);
+
+private:
+  // A directory on the path of the flush, and the subdirectory it is in.
+  struct Frame {
+    Dir *dir;
+    size_t next{0};
+    bool added{false};
+  };
+
+  const WalkOptions &options;
+  ThreadPool *pool;
+  uint64_t root_dev;
+  std::atomic<int> open_dirs{0};
+  FileTable &table;
+  std::vector<FileTable::Index> &group;
+  std::mutex flush_mutex;
+  std::vector<Frame> pending;
+
+  void done(Dir &dir);
+
+  void read_entries(Dir &dir, std::vector<std::string> &subdir_names);
+  void add_entry(Dir &dir, const char *name, unsigned char d_type,
+                 std::vector<std::string> &subdir_names);
+  bool accept(const FileStat &file_stat) const {
+    return file_stat.size >= options.min_size &&
+           file_stat.size <= options.max_size;
+  }
+  static bool readable(const Dir &dir, const char *name);
+};
+
+std::string join(const std::string &dir, const char *name) {
+  if (!dir.empty() && dir.back() == '/')
+    return dir + name;
+  return dir + '/' + name;
+}
+
+/**
+ * @brief Whether a file of a directory may be read, logging it otherwise.
+ */
+bool Walk::readable(const Dir &dir, const char *name) {
+  if (is_readable(dir.fd, name))
+    return true;
+  spdlog::warn("Could not open file, skipping: {}", join(dir.path, name));
+  return false;
+}
+
+/**
+ * @brief Mark a directory as read and add the files of the walk to the table,
+ * depth first in name order, up to the first directory which is not read yet.
+ * The entries of every directory are freed once they are in the table, and a
+ * subdirectory once all of its tree is.  A directory must not be touched after
+ * it is marked, it may be freed at once.
+ */
+void Walk::done(Dir &dir) {
+  const std::lock_guard<std::mutex> lock(flush_mutex);
+  dir.done = true;
+  while (!pending.empty()) {
+    Frame &top = pending.back();
+    if (!top.dir->done)
+      return;
+    if (!top.added) {
+      Dir &read = *top.dir;
+      for (const auto &entry : read.files)
+        group.push_back(table.add(join(read.path, entry.name.c_str()),
+                                  entry.file_stat));
+      std::vector<Entry>().swap(read.files);
+      top.added = true;
+    }
+    if (top.next < top.dir->subdirs.size()) {
+      pending.push_back(Frame{top.dir->subdirs.at(top.next).get()});
+      continue;
+    }
+    pending.pop_back();
+    if (!pending.empty()) {
+      Frame &parent = pending.back();
+      parent.dir->subdirs.at(parent.next++).reset();
+    }
+  }
+}
+
+/**
+ * @brief Read a directory, then walk its subdirectories, on the pool if there
+ * is one.
+ */
+void Walk::visit(Dir &dir) {
+  if (dir.fd < 0)
+    dir.fd = open(dir.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  else
+    --open_dirs;
+  if (dir.fd < 0) {
+    spdlog::warn("Could not open directory, skipping: {}", dir.path);
+    done(dir);
+    return;
+  }
+
+  std::vector<std::string> subdir_names;
+  read_entries(dir, subdir_names);
+  std::sort(dir.files.begin(), dir.files.end(),
+            [](const Entry &a, const Entry &b) { return a.name < b.name; });
+  std::sort(subdir_names.begin(), subdir_names.end());
+
+  for (const auto &name : subdir_names) {
+    auto subdir = std::make_unique<Dir>();
+    subdir->path = join(dir.path, name.c_str());
+    if (options.same_filesystem) {
+      std::optional<FileStat> st =
+          stat_at(dir.fd, name.c_str(), AT_SYMLINK_NOFOLLOW);
+      if (!st || st->dev != root_dev)
+        continue;
+    }
+    if (open_dirs.fetch_add(1) < max_open_dirs)
+      subdir->fd = openat(dir.fd, name.c_str(),
+                          O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (subdir->fd < 0)
+      --open_dirs;
+    dir.subdirs.emplace_back(std::move(subdir));
+  }
+  close(dir.fd);
+  dir.fd = -1;
+
+  std::vector<Dir *> subdirs;
+  for (auto &subdir : dir.subdirs)
+    subdirs.push_back(subdir.get());
+  done(dir);
+  for (Dir *d : subdirs) {
+    if (pool == nullptr)
+      visit(*d);
+    else
+      pool->submit([this, d]() { visit(*d); });
+  }
+}
+
+void Walk::read_entries(Dir &dir, std::vector<std::string> &subdir_names) {
+  std::vector<char> buffer(dirents_size);
+  for (;;) {
+    long n = syscall(SYS_getdents64, dir.fd, buffer.data(), buffer.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      spdlog::warn("Error reading directory: {}: {}", dir.path,
+                   strerror(errno));
+    if (n <= 0)
+      return;
+    for (long offset = 0; offset < n;) {
+      auto *d = reinterpret_cast<linux_dirent64 *>(buffer.data() + offset);
+      offset += d->d_reclen;
+      if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+        continue;
+      add_entry(dir, d->d_name, d->d_type, subdir_names);
+    }
+  }
+}
+
+/**
+ * @brief Sort an entry of a directory into its files or its subdirectories.
+ * The type comes from the directory entry, only filesystems which do not fill
+ * it in cost an extra stat.
+ */
+void Walk::add_entry(Dir &dir, const char *name, unsigned char d_type,
+                     std::vector<std::string> &subdir_names) {
+  std::optional<FileStat> st;
+  if (d_type == DT_UNKNOWN) {
+    st = stat_at(dir.fd, name, AT_SYMLINK_NOFOLLOW);
+    if (!st)
+      return;
+    d_type = S_ISDIR(st->mode)   ? DT_DIR
+             : S_ISREG(st->mode) ? DT_REG
+             : S_ISLNK(st->mode) ? DT_LNK
+                                 : DT_UNKNOWN;
+  }
+
+  if (d_type == DT_DIR) {
+    subdir_names.emplace_back(name);
+  } else if (d_type == DT_REG) {
+    if (!options.accepted.contains(FileType::regular_file))
+      return;
+    if (!st)
+      st = stat_at(dir.fd, name, AT_SYMLINK_NOFOLLOW);
+    if (st && S_ISREG(st->mode) && accept(*st) && readable(dir, name))
+      dir.files.push_back(Entry{name, FileType::regular_file, *st});
+  } else if (d_type == DT_LNK) {
+    if (!options.accepted.contains(FileType::symlinked_file))
+      return;
+    st = stat_at(dir.fd, name, 0);
+    if (st && S_ISREG(st->mode) && accept(*st) && readable(dir, name))
+      dir.files.push_back(Entry{name, FileType::symlinked_file, *st});
+  }
+}
+} // namespace
+
+/**
+ * @brief Walk directory trees into a FileTable, instead of reading a list of
+ * paths.  The directories are read with getdents64() and the files stat'ed
+ * relative to the fd of their directory, so no path is resolved from the root
+ * and every file is stat'ed once.  With a pool, every directory is a task of
+ * its own.  The files go in one group, sorted by path within every directory,
+ * the files of a directory before its subdirectories.  A directory's files go
+ * into the table as soon as it and the directories before it are read, so the
+ * walk does not hold the whole tree.
+ *
+ * @param roots The directories to walk.  A root which is a file is taken as it
+ * is.
+ * @param options The predicates the files must match.
+ * @param table The table to add the files to.
+ * @param initial_groups Gets the group of all the files added.
+ * @param pool The pool the walk runs on, nullptr to walk here.
+ */
+void Walker::walk(const std::vector<std::string> &roots,
+                  const WalkOptions &options, FileTable &table,
+                  IndexGroups &initial_groups, ThreadPool *pool) {
+  std::vector<FileTable::Index> group;
+  for (const auto &root : roots) {
+    std::optional<FileStat> file_stat;
+    FileType file_type = probe_path(root.c_str(), file_stat);
+    if (file_type != FileType::regular_dir &&
+        file_type != FileType::symlinked_dir) {
+      if (check_type_or_log(root, file_type, file_stat,
+                            is_readable(AT_FDCWD, root.c_str()),
+                            options.accepted))
+        group.push_back(table.add(root, *file_stat));
+      continue;
+    }
+
+    Dir dir;
+    dir.path = root;
+    Walk walk{options, pool, file_stat->dev, dir, table, group};
+    if (pool == nullptr)
+      walk.visit(dir);
+    else {
+      pool->submit([&walk, &dir]() { walk.visit(dir); });
+      pool->wait();
+    }
+  }
+  initial_groups.add(group);
+}
@@ -0,0 +1,48 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#pragma once
+#include <stdint.h> // for uint64_t, UINT64_MAX
+
+#include <set>    // for set
+#include <string> // for string
+#include <vector> // for vector
+
+#include "file.h"        // for FileType
+#include "file_table.h"  // for FileTable, IndexGroups
+#include "thread_pool.h" // for ThreadPool
+
+/**
+ * @brief The find-like predicates of a walk.  Symlinks are never followed
+ * into directories; with symlinked_file accepted, a symlink to a file is taken
+ * with the metadata of the file.
+ */
+struct WalkOptions {
+  std::set<FileType> accepted{FileType::regular_file};
+  uint64_t min_size{0};
+  uint64_t max_size{UINT64_MAX};
+  // Do not descend into directories on other filesystems than their root.
+  bool same_filesystem{false};
+};
+
+namespace Walker {
+void walk(const std::vector<std::string> &roots, const WalkOptions &options,
+          FileTable &table, IndexGroups &initial_groups,
+          ThreadPool *pool = nullptr);
+} // namespace Walker
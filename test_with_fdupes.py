@@ -74,10 +74,18 @@ def get_undupes_output(path="."):
 
     for ele in json_output:
         if ele["file_list"]:
-            ele_list = ele["file_list"]
-            ele_list.sort()
-            file_sets.append(ele_list)
-
+            file_sets.append(set(ele["file_list"]))
+
+    # fdupes -H reports hard links together with the copies, undupes reports
+    # them as separate "same_inode" sets.  Merge the sets sharing a path.
+    merged = []
+    for file_set in file_sets:
+        for other in [x for x in merged if x & file_set]:
+            file_set |= other
+            merged.remove(other)
+        merged.append(file_set)
+
+    file_sets = [sorted(x) for x in merged]
     file_sets.sort()
     return file_sets
 
@@ -0,0 +1,145 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "async_reader.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "page_cache.h"
+
+class AsyncReaderTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {}
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {}
+
+  // Read the files with the reader and return their contents.
+  std::vector<std::string> read_all(AsyncReader &reader, uint64_t limit,
+                                    std::vector<bool> &ok) {
+    std::vector<std::string> contents(paths.size());
+    reader.read_files(
+        paths, limit,
+        [&contents](size_t index, const unsigned char *data, size_t size) {
+          contents.at(index).append(reinterpret_cast<const char *>(data),
+                                    size);
+        },
+        ok);
+    return contents;
+  }
+
+  std::vector<std::string> paths = {
+      "artifacts/sample_1.pdf", "artifacts/dir_2/1KB_1",
+      "artifacts/non_existent_file", "artifacts/dir_3/4KB_1",
+      "artifacts/sample_1.pdf.copy"};
+};
+
+TEST_F(AsyncReaderTest, PreadReadsWholeFiles) {
+  PreadReader reader{4096};
+  std::vector<bool> ok;
+  auto contents = read_all(reader, 0, ok);
+  EXPECT_EQ(ok, (std::vector<bool>{true, true, false, true, true}));
+  EXPECT_EQ(contents.at(0).size(),
+            std::filesystem::file_size("artifacts/sample_1.pdf"));
+  EXPECT_EQ(contents.at(0), contents.at(4));
+  EXPECT_EQ(contents.at(1).size(), 1024);
+}
+
+TEST_F(AsyncReaderTest, ReadersAgree) {
+  // The io_uring reader is compared against the pread one, if the kernel
+  // lets us have one.
+  std::unique_ptr<AsyncReader> reader = AsyncReader::create(8, 4096);
+  PreadReader pread_reader{4096};
+  for (uint64_t limit : {uint64_t{0}, uint64_t{4096}, uint64_t{10000}}) {
+    std::vector<bool> ok, expected_ok;
+    auto contents = read_all(*reader, limit, ok);
+    auto expected = read_all(pread_reader, limit, expected_ok);
+    EXPECT_EQ(ok, expected_ok);
+    EXPECT_EQ(contents, expected);
+  }
+}
+
+TEST_F(AsyncReaderTest, ReadRanges) {
+  std::unique_ptr<AsyncReader> reader = AsyncReader::create(8, 4096);
+  PreadReader pread_reader{4096};
+  std::vector<bool> ok;
+  auto whole = read_all(pread_reader, 0, ok);
+  std::vector<uint64_t> offsets = {5000, 0, 0, 4096, 100000000};
+  for (AsyncReader *r : {static_cast<AsyncReader *>(&pread_reader),
+                         reader.get()}) {
+    std::vector<std::string> contents(paths.size());
+    r->read_ranges(
+        paths, offsets, 10000,
+        [&contents](size_t index, const unsigned char *data, size_t size) {
+          contents.at(index).append(reinterpret_cast<const char *>(data),
+                                    size);
+        },
+        ok);
+    EXPECT_EQ(ok, (std::vector<bool>{true, true, false, true, true}));
+    EXPECT_EQ(contents.at(0), whole.at(0).substr(5000, 5000));
+    EXPECT_EQ(contents.at(1), whole.at(1));
+    EXPECT_EQ(contents.at(3), whole.at(3).substr(4096));
+    EXPECT_EQ(contents.at(4), "");
+  }
+}
+
+TEST_F(AsyncReaderTest, BypassingThePageCache) {
+  std::unique_ptr<AsyncReader> reader = AsyncReader::create(8, 4096);
+  PreadReader pread_reader{4096};
+  for (uint64_t limit : {uint64_t{0}, uint64_t{10000}}) {
+    std::vector<bool> ok, expected_ok;
+    PageCache::set_bypass(false);
+    auto expected = read_all(pread_reader, limit, expected_ok);
+    // Reads past the limit, at unaligned offsets, or on a filesystem without
+    // O_DIRECT all give the same data.
+    PageCache::set_bypass(true);
+    for (AsyncReader *r : {static_cast<AsyncReader *>(&pread_reader),
+                           reader.get()}) {
+      EXPECT_EQ(read_all(*r, limit, ok), expected);
+      EXPECT_EQ(ok, expected_ok);
+    }
+  }
+  PageCache::set_bypass(false);
+}
+
+TEST_F(AsyncReaderTest, ExceptionsCloseTheFiles) {
+  auto open_files = []() {
+    return std::distance(std::filesystem::directory_iterator{"/proc/self/fd"},
+                         std::filesystem::directory_iterator{});
+  };
+  std::unique_ptr<AsyncReader> reader = AsyncReader::create(8, 4096);
+  std::vector<bool> ok;
+  auto before = open_files();
+  EXPECT_THROW(reader->read_files(
+                   paths, 0,
+                   [](size_t, const unsigned char *, size_t) {
+                     throw std::runtime_error("Stop reading.");
+                   },
+                   ok),
+               std::runtime_error);
+  EXPECT_EQ(open_files(), before);
+}
@@ -43,3 +43,54 @@ TEST_F(BinCompareFilesTest, SimpleTestFalse) {
 
   EXPECT_FALSE(compare_files_fdupes(file_1, file_2));
 }
+
+TEST_F(BinCompareFilesTest, LockstepClasses) {
+  std::vector<std::string> files = {
+      "artifacts/dir_3/1KB_1",        "artifacts/dir_3/1KB_2",
+      "artifacts/dir_3/1KB_1.copy.1", "artifacts/dir_3/1KB_3",
+      "artifacts/dir_3/1KB_2.copy.1", "artifacts/dir_3/1KB_1.copy.2",
+  };
+  FileClasses expected = {{0, 2, 5}, {1, 4}, {3}};
+  EXPECT_EQ(compare_files_lockstep(files), expected);
+}
+
+TEST_F(BinCompareFilesTest, LockstepMultipleChunks) {
+  // Larger than one chunk, so the classes are carried over several reads.
+  std::vector<std::string> files = {"artifacts/sample_1.pdf",
+                                    "artifacts/dir_2/1KB_1",
+                                    "artifacts/sample_1.pdf.copy"};
+  FileClasses expected = {{0, 2}, {1}};
+  EXPECT_EQ(compare_files_lockstep(files), expected);
+}
+
+TEST_F(BinCompareFilesTest, LockstepChunked) {
+  std::vector<std::string> files = {"artifacts/sample_1.pdf",
+                                    "artifacts/dir_2/1KB_1",
+                                    "artifacts/sample_1.pdf.copy"};
+  FileClasses expected = {{0, 2}, {1}};
+  for (size_t chunk : {size_t{0}, size_t{4096}, size_t{1 << 20}})
+    EXPECT_EQ(compare_files_lockstep_chunked(files, chunk), expected);
+}
+
+TEST_F(BinCompareFilesTest, LockstepSkipsMissingFiles) {
+  std::vector<std::string> files = {"artifacts/dir_3/4KB_1",
+                                    "artifacts/non_existent_file",
+                                    "artifacts/dir_3/4KB_1.copy.1"};
+  FileClasses expected = {{0, 2}};
+  EXPECT_EQ(compare_files_lockstep(files), expected);
+}
+
+TEST_F(BinCompareFilesTest, LockstepInRounds) {
+  // Fewer files at once than the group has, so it is compared in rounds.
+  std::vector<std::string> files = {
+      "artifacts/dir_3/1KB_1",        "artifacts/non_existent_file",
+      "artifacts/dir_3/1KB_2",        "artifacts/dir_3/1KB_1.copy.1",
+      "artifacts/dir_3/1KB_3",        "artifacts/dir_3/1KB_2.copy.1",
+      "artifacts/dir_3/1KB_1.copy.2",
+  };
+  FileClasses expected = {{0, 3, 6}, {2, 5}, {4}};
+  EXPECT_EQ(compare_files_lockstep(files), expected);
+  for (size_t max_files : {2, 3, 4})
+    EXPECT_EQ(compare_files_lockstep_chunked(files, 4096, max_files),
+              expected);
+}
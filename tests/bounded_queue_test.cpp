@@ -0,0 +1,82 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "bounded_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+class BoundedQueueTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {}
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {}
+};
+
+TEST_F(BoundedQueueTest, FullAndEmpty) {
+  BoundedQueue<int> queue{4};
+  int item = 0;
+  EXPECT_FALSE(queue.try_pop(item));
+  for (int i = 0; i < 4; ++i) {
+    item = i;
+    EXPECT_TRUE(queue.try_push(item));
+  }
+  item = 4;
+  EXPECT_FALSE(queue.try_push(item));
+  for (int i = 0; i < 4; ++i)
+    EXPECT_EQ(queue.pop(), i);
+  EXPECT_FALSE(queue.try_pop(item));
+}
+
+TEST_F(BoundedQueueTest, ManyProducersAndConsumers) {
+  constexpr size_t num_threads = 4, per_thread = 20000;
+  BoundedQueue<size_t> queue{8};
+  std::vector<std::vector<size_t>> seen(num_threads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; ++t)
+    threads.emplace_back([&queue, t]() {
+      for (size_t i = 0; i < per_thread; ++i)
+        queue.push(t * per_thread + i);
+    });
+  for (size_t t = 0; t < num_threads; ++t)
+    threads.emplace_back([&queue, &items = seen.at(t)]() {
+      for (size_t i = 0; i < per_thread; ++i)
+        items.push_back(queue.pop());
+    });
+  for (auto &thread : threads)
+    thread.join();
+
+  // Every item comes out once, and the items of one producer in order.
+  std::vector<int> count(num_threads * per_thread, 0);
+  for (const auto &items : seen) {
+    std::vector<size_t> last(num_threads, 0);
+    for (size_t item : items) {
+      ++count.at(item);
+      EXPECT_GE(item % per_thread + 1, last.at(item / per_thread));
+      last.at(item / per_thread) = item % per_thread + 1;
+    }
+  }
+  for (int c : count)
+    EXPECT_EQ(c, 1);
+}
@@ -0,0 +1,103 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "compare_kernel.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+class CompareKernelTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    std::mt19937 random{42};
+    reference.resize(70000);
+    for (auto &byte : reference)
+      byte = static_cast<unsigned char>(random());
+    for (CompareKernel::Kind kind : CompareKernel::kinds)
+      if (CompareKernel::supported(kind))
+        kinds.push_back(kind);
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { CompareKernel::use(CompareKernel::best()); }
+
+  std::vector<unsigned char> reference;
+  std::vector<CompareKernel::Kind> kinds;
+};
+
+TEST_F(CompareKernelTest, BestIsSupported) {
+  EXPECT_TRUE(CompareKernel::supported(CompareKernel::Kind::scalar));
+  EXPECT_TRUE(CompareKernel::supported(CompareKernel::best()));
+  EXPECT_EQ(CompareKernel::active(), CompareKernel::best());
+}
+
+TEST_F(CompareKernelTest, FindsTheFirstDifference) {
+  for (CompareKernel::Kind kind : kinds) {
+    CompareKernel::use(kind);
+    SCOPED_TRACE(CompareKernel::name(kind));
+    // Every size around the vector widths and their unrolled loops, with the
+    // difference at every offset, and none.
+    for (size_t size = 0; size <= 300; ++size) {
+      std::vector<unsigned char> other(reference.begin(),
+                                       reference.begin() + size);
+      EXPECT_EQ(CompareKernel::first_difference(reference.data(),
+                                                other.data(), size),
+                size);
+      for (size_t at = 0; at < size; ++at) {
+        other.at(at) ^= 0x10;
+        ASSERT_EQ(CompareKernel::first_difference(reference.data(),
+                                                  other.data(), size),
+                  at);
+        // A later difference does not change it.
+        other.at(size - 1) ^= 0x01;
+        ASSERT_EQ(CompareKernel::first_difference(reference.data(),
+                                                  other.data(), size),
+                  at);
+        other.at(size - 1) ^= 0x01;
+        other.at(at) ^= 0x10;
+      }
+    }
+  }
+}
+
+TEST_F(CompareKernelTest, ComparesManyCandidates) {
+  const size_t size = reference.size();
+  std::vector<size_t> differ_at{size, 0, 4095, 16384, 16385, size - 1, size};
+  std::vector<std::vector<unsigned char>> buffers;
+  std::vector<const unsigned char *> candidates;
+  for (size_t at : differ_at) {
+    buffers.push_back(reference);
+    if (at < size)
+      buffers.back().at(at) ^= 0x80;
+  }
+  for (const auto &buffer : buffers)
+    candidates.push_back(buffer.data());
+
+  for (CompareKernel::Kind kind : kinds) {
+    CompareKernel::use(kind);
+    SCOPED_TRACE(CompareKernel::name(kind));
+    std::vector<size_t> offsets(candidates.size(), 1);
+    CompareKernel::first_differences(reference.data(), candidates.data(),
+                                     candidates.size(), size, offsets.data());
+    EXPECT_EQ(offsets, differ_at);
+  }
+}
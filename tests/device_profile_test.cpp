@@ -0,0 +1,72 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "device_profile.h"
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+class DeviceProfileTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override { ASSERT_EQ(stat("artifacts", &st), 0); }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {}
+
+  struct stat st;
+};
+
+TEST_F(DeviceProfileTest, Kinds) {
+  DeviceProfile ssd = DeviceProfile::for_kind(DeviceProfile::Kind::solid_state);
+  EXPECT_EQ(ssd.queue_depth, 0);
+  EXPECT_EQ(ssd.block_size, 64 * (1 << 10));
+  EXPECT_EQ(ssd.max_active, 0);
+
+  DeviceProfile hdd = DeviceProfile::for_kind(DeviceProfile::Kind::rotational);
+  EXPECT_EQ(hdd.queue_depth, 1);
+  EXPECT_EQ(hdd.block_size, 1 << 20);
+  EXPECT_EQ(hdd.max_active, 1);
+
+  DeviceProfile nfs = DeviceProfile::for_kind(DeviceProfile::Kind::network);
+  EXPECT_EQ(nfs.block_size, 1 << 20);
+  EXPECT_EQ(nfs.max_active, 2);
+  EXPECT_STREQ(nfs.name(), "network");
+}
+
+TEST_F(DeviceProfileTest, DetectedOnce) {
+  const DeviceProfile &profile = DeviceProfiles::get(st.st_dev, "artifacts");
+  EXPECT_EQ(profile.kind, DeviceProfiles::detect(st.st_dev, "artifacts"));
+  EXPECT_EQ(&DeviceProfiles::get(st.st_dev, "artifacts"), &profile);
+}
+
+TEST_F(DeviceProfileTest, Set) {
+  DeviceProfiles::set(st.st_dev, DeviceProfile::for_kind(
+                                     DeviceProfile::Kind::rotational));
+  EXPECT_EQ(DeviceProfiles::get(st.st_dev, "artifacts").kind,
+            DeviceProfile::Kind::rotational);
+  EXPECT_EQ(DeviceProfiles::get(st.st_dev, nullptr).queue_depth, 1);
+}
+
+TEST_F(DeviceProfileTest, UnknownDevice) {
+  // No sysfs entry and no file to statfs.
+  EXPECT_EQ(DeviceProfiles::detect(makedev(0, 0xfffff), nullptr),
+            DeviceProfile::Kind::solid_state);
+}
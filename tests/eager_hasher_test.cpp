@@ -0,0 +1,116 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "eager_hasher.h"
+
+#include <fcntl.h> // for AT_FDCWD
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "filters_list.h"
+
+namespace fs = std::filesystem;
+
+class EagerHasherTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    // a, b and d share a size, c has one of its own and e differs from d
+    // past the first 4KB.
+    write(dir / "a", std::string(10000, 'x'));
+    write(dir / "b", std::string(10000, 'y'));
+    write(dir / "c", std::string(20, 'x'));
+    write(dir / "d", std::string(10000, 'x'));
+    write(dir / "e", std::string(9999, 'x') + "z");
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { fs::remove_all(dir); }
+
+  static void write(const fs::path &path, const std::string &content) {
+    std::ofstream{path} << content;
+  }
+
+  void fill(FileTable &table, EagerHasher &eager) {
+    for (const char *name : {"a", "b", "c", "d", "e"}) {
+      std::string path = (dir / name).string();
+      eager.added(table.add(path, *stat_at(AT_FDCWD, path.c_str(), 0)));
+    }
+    eager.finish();
+  }
+
+  fs::path dir = fs::temp_directory_path() / "undupes_eager_hasher_test";
+};
+
+TEST_F(EagerHasherTest, HashesFilesSharingASize) {
+  for (bool with_pool : {false, true}) {
+    std::unique_ptr<ThreadPool> pool;
+    if (with_pool)
+      pool = std::make_unique<ThreadPool>(3);
+    FileTable table;
+    EagerHasher eager{table, pool.get()};
+    fill(table, eager);
+    EXPECT_EQ(eager.num_hashed(), 4);
+    EXPECT_FALSE(table.has_head(2));
+    for (FileTable::Index i : {0, 1, 3, 4}) {
+      ASSERT_TRUE(table.has_head(i));
+      EXPECT_EQ(table.head(i), FiltersList::xxhash_heads({table.path(i)})[0]);
+    }
+  }
+}
+
+TEST_F(EagerHasherTest, ProgressiveUsesHeads) {
+  FileTable table;
+  EagerHasher eager{table, nullptr};
+  fill(table, eager);
+  std::vector<FileTable::Index> group = {0, 1, 3, 4};
+  FileClasses classes = FiltersList::xxhash_progressive(table, group);
+  ASSERT_EQ(classes.size(), 1);
+  EXPECT_EQ(classes.at(0), (std::vector<size_t>{0, 2}));
+  EXPECT_EQ(table.digest(0), table.digest(3));
+  EXPECT_NE(table.digest(0), table.digest(4));
+}
+
+TEST_F(EagerHasherTest, CountsInodesNotPaths) {
+  // Two paths to c make no second file of its size, and the link to a is not
+  // hashed again.
+  fs::create_hard_link(dir / "c", dir / "c.link");
+  fs::create_hard_link(dir / "a", dir / "a.link");
+  FileTable table;
+  EagerHasher eager{table, nullptr};
+  for (const char *name : {"c", "c.link", "a", "a.link", "b"}) {
+    std::string path = (dir / name).string();
+    eager.added(table.add(path, *stat_at(AT_FDCWD, path.c_str(), 0)));
+  }
+  eager.finish();
+  EXPECT_EQ(eager.num_hashed(), 2);
+  for (FileTable::Index i : {0, 1, 3})
+    EXPECT_FALSE(table.has_head(i));
+  EXPECT_TRUE(table.has_head(2));
+  EXPECT_TRUE(table.has_head(4));
+}
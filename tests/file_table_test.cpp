@@ -0,0 +1,68 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "file_table.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+class FileTableTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {}
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {}
+};
+
+TEST_F(FileTableTest, Columns) {
+  FileTable table;
+  EXPECT_EQ(table.add("a/b", FileStat{10, 1, 2, 0, 3, 4, 0, 0, 0}), 0u);
+  EXPECT_EQ(table.add("", FileStat{20, 5, 6, 0, 7, 8, 0, 0, 0}), 1u);
+  EXPECT_EQ(table.add("c", FileStat{30, 9, 10, 0, 11, 12, 0, 0, 0}), 2u);
+  ASSERT_EQ(table.size(), 3);
+  EXPECT_EQ(table.path(0), "a/b");
+  EXPECT_EQ(table.path(1), "");
+  EXPECT_EQ(table.path(2), "c");
+  EXPECT_EQ(table.file_size(1), 20);
+  EXPECT_EQ(table.dev(2), 9);
+  EXPECT_EQ(table.ino(2), 10);
+  EXPECT_EQ(table.mtime_ns(0), 3);
+  EXPECT_EQ(table.ctime_ns(0), 4);
+
+  table.set_digest(1, Hash128{1, 2});
+  EXPECT_EQ(table.digest(1), (Hash128{1, 2}));
+  EXPECT_EQ(table.digest(0), (Hash128{0, 0}));
+}
+
+TEST_F(FileTableTest, IndexGroups) {
+  IndexGroups groups;
+  EXPECT_TRUE(groups.empty());
+  std::vector<IndexGroups::Index> a{3, 1, 2}, b{7};
+  groups.add(a);
+  groups.add(b);
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_EQ(groups.num_indices(), 4);
+  EXPECT_EQ(std::vector<IndexGroups::Index>(groups[0].begin(), groups[0].end()),
+            a);
+  EXPECT_EQ(std::vector<IndexGroups::Index>(groups[1].begin(), groups[1].end()),
+            b);
+}
@@ -57,6 +57,18 @@ TEST_F(FileTest, GetFileTypeTest) {
   EXPECT_EQ(non_existent_object_1.get_file_type(), FileType::other);
 }
 
+TEST_F(FileTest, GetStat) {
+  ASSERT_TRUE(file_object_1.get_stat().has_value());
+  EXPECT_EQ(file_object_1.get_stat()->size,
+            std::filesystem::file_size("artifacts/dir_1/file_1"));
+  // A symlink carries the metadata of the file it points to.
+  ASSERT_TRUE(symlink_object_1.get_stat().has_value());
+  EXPECT_EQ(symlink_object_1.get_stat()->ino, file_object_1.get_stat()->ino);
+  EXPECT_EQ(symlink_object_1.get_stat()->dev, file_object_1.get_stat()->dev);
+  EXPECT_FALSE(broken_symlink_object_1.get_stat().has_value());
+  EXPECT_FALSE(non_existent_object_1.get_stat().has_value());
+}
+
 TEST_F(FileTest, GetResolvedDirEntry) {
   EXPECT_EQ(nested_symlink_object_1.get_resolved_dir_entry(),
             std::filesystem::current_path() / "artifacts/dir_1/file_1");
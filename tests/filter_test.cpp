@@ -17,138 +17,190 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 // SPDX-License-Identifier: AGPL-3.0
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#define XXH_PRIVATE_API 0
 #include "filter.h"
 #include <gtest/gtest.h> // for TestInfo (ptr only), EXPECT_EQ, TEST_F
+#include <xxhash.h>      // for XXH3_128bits
 
-#include <filesystem> // for recursive_directory_iterator, begin
-#include <ostream>    // for operator<<
+#include <algorithm>  // for sort
+#include <filesystem> // for directory_iterator, path
+#include <fstream>    // for ifstream
+#include <iterator>   // for istreambuf_iterator
+#include <string>     // for string
+#include <vector>     // for vector
 
-#include "bin_compare_files.h" // for compare_files_fdupes
+#include "bin_compare_files.h" // for compare_files_lockstep
 #include "file.h"              // for File
-#include "filters_list.h"      // for xxhash, fs, file_size
+#include "filters_list.h"      // for fs
 
 class FilterTest : public testing::Test {
 protected:
+  using Sets = std::vector<std::vector<std::string>>;
+
   // Remember that SetUp() is run immediately before a test starts.
   void SetUp() override {
-    read_dir("artifacts/dir_2", file_sets_dir_2);
-    read_dir("artifacts/dir_3", file_sets_dir_3);
+    read_dir("artifacts/dir_2", groups_dir_2);
+    read_dir("artifacts/dir_3", groups_dir_3);
   }
 
   // TearDown() is invoked immediately after a test finishes.
   void TearDown() override {}
-  void read_dir(const std::string &dir, FileSets &_file_sets) {
-    FileVector file_vector;
-    for (const fs::directory_entry &dir_entry :
-         fs::recursive_directory_iterator(dir)) {
-      file_vector.emplace_back(new File{dir_entry.path()});
+
+  // Add the regular files of a directory to the table as one group, sorted by
+  // path.
+  void read_dir(const std::string &dir, IndexGroups &groups) {
+    std::vector<std::string> paths;
+    for (const fs::directory_entry &dir_entry : fs::directory_iterator(dir))
+      if (dir_entry.is_regular_file())
+        paths.push_back(dir_entry.path().string());
+    std::sort(paths.begin(), paths.end());
+    std::vector<FileTable::Index> group;
+    for (const auto &path : paths) {
+      File file{path};
+      group.push_back(table.add(path, *file.get_stat()));
     }
-    _file_sets.emplace_back(file_vector);
+    groups.add(group);
   }
-  FileSets file_sets_dir_2, file_sets_dir_3;
-};
 
-TEST_F(FilterTest, ConstructorFileSizeFilter) {
-  HashableFilter filter{file_sets_dir_2, FiltersList::file_size};
-  FileSets &new_file_sets = filter.new_file_sets;
-  EXPECT_EQ(new_file_sets.size(), 5);
-  FileSets expected_file_set;
-  for (int i = 1; i <= 5; ++i) {
-    FileVector file_vector;
-    for (int j = 1; j <= 5; ++j) {
-      FilePtr f = std::make_shared<File>(
-          "artifacts/dir_2/" + std::to_string(i) + "KB_" + std::to_string(j));
-      file_vector.push_back(f);
+  Sets paths(const IndexGroups &groups) const {
+    Sets result;
+    for (size_t g = 0; g < groups.size(); ++g) {
+      result.emplace_back();
+      for (FileTable::Index i : groups[g])
+        result.back().push_back(table.path(i));
     }
-    expected_file_set.push_back(file_vector);
+    return result;
   }
-  EXPECT_EQ(new_file_sets, expected_file_set);
-}
 
-TEST_F(FilterTest, ConstructorXxhashFilter) {
-  HashableFilter filter{file_sets_dir_2, FiltersList::xxhash};
-  const FileSets &new_file_sets = filter.new_file_sets;
-  filter.print_with_filter(new_file_sets, FiltersList::xxhash);
-  EXPECT_EQ(new_file_sets.size(), 0);
-}
+  // Split every group into the classes of identical contents, dropping the
+  // classes of a single file.
+  Sets compare(const IndexGroups &groups) const {
+    Sets result;
+    for (const auto &group : paths(groups))
+      for (const auto &same : compare_files_lockstep(group)) {
+        if (same.size() < 2)
+          continue;
+        result.emplace_back();
+        for (auto i : same)
+          result.back().push_back(group.at(i));
+      }
+    return result;
+  }
 
-TEST_F(FilterTest, ConstructorBinComparison) {
-  NonHashableFilter filter{file_sets_dir_3, compare_files_fdupes};
-  FileSets &new_file_sets = filter.new_file_sets;
-  auto ms = [](const std::string &file_name) {
-    return std::make_shared<File>("artifacts/dir_3/" + file_name);
-  };
+  // The XXH3 digest of the whole file.
+  static Hash128 xxhash(const FileTable &t, FileTable::Index i) {
+    std::ifstream in{t.path(i), std::ios::binary};
+    std::string data{std::istreambuf_iterator<char>{in}, {}};
+    XXH128_hash_t hash = XXH3_128bits(data.data(), data.size());
+    return Hash128{hash.low64, hash.high64};
+  }
+
+  static size_t file_size(const FileTable &t, FileTable::Index i) {
+    return t.file_size(i);
+  }
 
-  FileSets expected = {
+  static std::string in_dir_3(const std::string &file_name) {
+    return "artifacts/dir_3/" + file_name;
+  }
+
+  FileTable table;
+  IndexGroups groups_dir_2, groups_dir_3;
+  Sets duplicates_dir_3 = {
       {
-          ms("1KB_1"),
-          ms("1KB_1.copy.1"),
-          ms("1KB_1.copy.2"),
-          ms("1KB_1.copy.3"),
+          in_dir_3("1KB_1"),
+          in_dir_3("1KB_1.copy.1"),
+          in_dir_3("1KB_1.copy.2"),
+          in_dir_3("1KB_1.copy.3"),
       },
       {
-          ms("1KB_2"),
-          ms("1KB_2.copy.1"),
-          ms("1KB_2.copy.2"),
-          ms("1KB_2.copy.3"),
+          in_dir_3("1KB_2"),
+          in_dir_3("1KB_2.copy.1"),
+          in_dir_3("1KB_2.copy.2"),
+          in_dir_3("1KB_2.copy.3"),
       },
       {
-          ms("3KB_1"),
-          ms("3KB_1.copy.1"),
-          ms("3KB_1.copy.2"),
-          ms("3KB_1.copy.3"),
+          in_dir_3("3KB_1"),
+          in_dir_3("3KB_1.copy.1"),
+          in_dir_3("3KB_1.copy.2"),
+          in_dir_3("3KB_1.copy.3"),
       },
       {
-          ms("4KB_1"),
-          ms("4KB_1.copy.1"),
-          ms("4KB_1.copy.2"),
-          ms("4KB_1.copy.3"),
-          ms("4KB_1.copy.4"),
-          ms("4KB_1.copy.5"),
+          in_dir_3("4KB_1"),
+          in_dir_3("4KB_1.copy.1"),
+          in_dir_3("4KB_1.copy.2"),
+          in_dir_3("4KB_1.copy.3"),
+          in_dir_3("4KB_1.copy.4"),
+          in_dir_3("4KB_1.copy.5"),
       },
   };
+};
 
-  // IC(new_file_sets);
-  // filter.print_with_filter(new_file_sets, FiltersList::xxhash);
-  EXPECT_EQ(new_file_sets, expected);
+TEST_F(FilterTest, ConstructorFileSizeFilter) {
+  TableHashableFilter filter{table, groups_dir_2, file_size};
+  EXPECT_EQ(filter.new_groups.size(), 5);
+  Sets expected;
+  for (int i = 1; i <= 5; ++i) {
+    expected.emplace_back();
+    for (int j = 1; j <= 5; ++j)
+      expected.back().push_back("artifacts/dir_2/" + std::to_string(i) +
+                                "KB_" + std::to_string(j));
+  }
+  EXPECT_EQ(paths(filter.new_groups), expected);
 }
+
+TEST_F(FilterTest, ConstructorXxhashFilter) {
+  TableHashableFilter filter{table, groups_dir_2, xxhash};
+  EXPECT_EQ(filter.new_groups.size(), 0);
+}
+
+TEST_F(FilterTest, ConstructorBinComparison) {
+  EXPECT_EQ(compare(groups_dir_3), duplicates_dir_3);
+}
+
 TEST_F(FilterTest, ConstructorRealLife1) {
-  HashableFilter filter{file_sets_dir_3, FiltersList::xxhash};
-  FileSets &new_file_sets = filter.new_file_sets;
-  auto ms = [](const std::string &file_name) {
-    return std::make_shared<File>("artifacts/dir_3/" + file_name);
-  };
+  TableHashableFilter filter{table, groups_dir_3, xxhash};
+  EXPECT_EQ(paths(filter.new_groups), duplicates_dir_3);
+}
 
-  FileSets expected = {
-      {
-          ms("1KB_1"),
-          ms("1KB_1.copy.1"),
-          ms("1KB_1.copy.2"),
-          ms("1KB_1.copy.3"),
-      },
-      {
-          ms("1KB_2"),
-          ms("1KB_2.copy.1"),
-          ms("1KB_2.copy.2"),
-          ms("1KB_2.copy.3"),
-      },
-      {
-          ms("3KB_1"),
-          ms("3KB_1.copy.1"),
-          ms("3KB_1.copy.2"),
-          ms("3KB_1.copy.3"),
-      },
-      {
-          ms("4KB_1"),
-          ms("4KB_1.copy.1"),
-          ms("4KB_1.copy.2"),
-          ms("4KB_1.copy.3"),
-          ms("4KB_1.copy.4"),
-          ms("4KB_1.copy.5"),
-      },
-  };
+TEST_F(FilterTest, ParallelMatchesSerial) {
+  ThreadPool pool{4};
+
+  TableHashableFilter serial_size{table, groups_dir_3, file_size};
+  TableHashableFilter parallel_size{table, groups_dir_3, file_size, &pool};
+  EXPECT_EQ(paths(serial_size.new_groups), paths(parallel_size.new_groups));
+
+  TableHashableFilter serial_hash{table, serial_size.new_groups, xxhash};
+  TableHashableFilter parallel_hash{table, parallel_size.new_groups, xxhash,
+                                    &pool};
+  EXPECT_EQ(paths(serial_hash.new_groups), paths(parallel_hash.new_groups));
+  EXPECT_EQ(compare(parallel_hash.new_groups), duplicates_dir_3);
+}
+
+TEST_F(FilterTest, TableSameInodeFilter) {
+  fs::path dir = fs::temp_directory_path() / "undupes_table_same_inode_test";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  fs::copy_file("artifacts/dir_3/1KB_1", dir / "a");
+  fs::create_hard_link(dir / "a", dir / "a.link.1");
+  fs::copy_file("artifacts/dir_3/1KB_1", dir / "b");
+  fs::create_hard_link(dir / "a", dir / "a.link.2");
+
+  FileTable table;
+  IndexGroups groups;
+  std::vector<FileTable::Index> group;
+  for (const auto &name : {"a", "a.link.1", "b", "a.link.2"})
+    group.push_back(table.add((dir / name).string(),
+                              *File{(dir / name).string()}.get_stat()));
+  groups.add(group);
+  TableSameInodeFilter filter{table, groups};
 
-  // IC(new_file_sets);
-  // filter.print_with_filter(new_file_sets, FiltersList::xxhash);
-  EXPECT_EQ(new_file_sets, expected);
+  ASSERT_EQ(filter.new_groups.size(), 1);
+  EXPECT_EQ(std::vector<FileTable::Index>(filter.new_groups[0].begin(),
+                                          filter.new_groups[0].end()),
+            (std::vector<FileTable::Index>{0, 2}));
+  ASSERT_EQ(filter.same_inode_groups.size(), 1);
+  EXPECT_EQ(std::vector<FileTable::Index>(filter.same_inode_groups[0].begin(),
+                                          filter.same_inode_groups[0].end()),
+            (std::vector<FileTable::Index>{0, 1, 3}));
+  fs::remove_all(dir);
 }
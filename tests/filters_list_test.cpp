@@ -17,44 +17,98 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 // SPDX-License-Identifier: AGPL-3.0
 // SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
-#include "filters_list.h" // for xxhash, fs, file_size
+#include "filters_list.h" // for xxhash_heads, xxhash_progressive, to_hex
 
 #include <gtest/gtest.h> // for TestInfo (ptr only), EXPECT_EQ, TEST_F
 
-#include <exception>
+#include <fcntl.h>  // for AT_FDCWD
+#include <unistd.h> // for getpid
+
 #include <filesystem> // for recursive_directory_iterator, begin
-#include <memory>
+#include <fstream>
 #include <ostream> // for operator<<
 #include <string>
+#include <vector>
 
-#include "debug.h"
+#include "file.h" // for stat_at
 
 using namespace std;
 class FiltersListTest : public testing::Test {
 protected:
   // Remember that SetUp() is run immediately before a test starts.
-  void SetUp() override {}
+  void SetUp() override { fs::create_directories(dir); }
 
   // TearDown() is invoked immediately after a test finishes.
-  void TearDown() override {}
+  void TearDown() override {
+    FiltersList::set_mmap_threshold(64 * (1 << 20));
+    FiltersList::set_read_queue_depth(1);
+    fs::remove_all(dir);
+  }
+
+  FileTable::Index add(const fs::path &path) {
+    return table.add(path.string(),
+                     *stat_at(AT_FDCWD, path.string().c_str(), 0));
+  }
+
+  fs::path write(const std::string &name, const std::string &data) {
+    std::ofstream{dir / name, std::ios::binary} << data;
+    return dir / name;
+  }
+
+  fs::path dir = fs::temp_directory_path() /
+                 ("undupes_filters_list_test_" + std::to_string(getpid()));
+  FileTable table;
 };
 
-TEST_F(FiltersListTest, xxhashT4KBTest) {
-  FilePtr f = make_shared<File>("artifacts/dir_3/4KB_1");
-  std::string hash = FiltersList::xxhash_4KB(f);
-  IC(hash);
-  // xxh128sum artifacts/dir_3/4KB_1
-  EXPECT_EQ(hash, "9095db0480326fe09475cd87df7cdb81");
-
-  f = make_shared<File>("artifacts/sample_1.pdf");
-  hash = FiltersList::xxhash_4KB(f);
-  // head -c 4096 ./artifacts/sample_1.pdf
-  EXPECT_EQ(hash, "1cdfeb1e989503ea743248b5a8122fc3");
+TEST_F(FiltersListTest, xxhashHeadsTest) {
+  for (size_t queue_depth : {1, 8}) {
+    FiltersList::set_read_queue_depth(queue_depth);
+    FiltersList::HashVector heads = FiltersList::xxhash_heads(
+        {"artifacts/dir_3/4KB_1", "artifacts/non_existent_file",
+         "artifacts/sample_1.pdf"});
+    // xxh128sum artifacts/dir_3/4KB_1
+    EXPECT_EQ(FiltersList::to_hex(*heads.at(0)),
+              "9095db0480326fe09475cd87df7cdb81");
+    EXPECT_FALSE(heads.at(1).has_value());
+    // head -c 4096 ./artifacts/sample_1.pdf | xxh128sum
+    EXPECT_EQ(FiltersList::to_hex(*heads.at(2)),
+              "1cdfeb1e989503ea743248b5a8122fc3");
+  }
 }
 
-TEST_F(FiltersListTest, xxhashTest) {
-  FilePtr f = make_shared<File>("artifacts/sample_1.pdf");
-  string hash = FiltersList::xxhash(f);
-  // xxh128sum artifacts/sample_1.pdf
-  EXPECT_EQ(hash, "a9e96523afa48867198c85f09dff5983");
+TEST_F(FiltersListTest, xxhashProgressiveDigestTest) {
+  fs::copy_file("artifacts/sample_1.pdf", dir / "a.pdf");
+  fs::copy_file("artifacts/sample_1.pdf", dir / "b.pdf");
+  std::vector<FileTable::Index> group = {add(dir / "a.pdf"),
+                                         add(dir / "b.pdf")};
+  // With a threshold of one byte the files are hashed through a mapping.
+  for (uint64_t threshold : {uint64_t{64 * (1 << 20)}, uint64_t{1}}) {
+    FiltersList::set_mmap_threshold(threshold);
+    EXPECT_EQ(FiltersList::xxhash_progressive(table, group),
+              (FileClasses{{0, 1}}));
+    // xxh128sum artifacts/sample_1.pdf
+    EXPECT_EQ(FiltersList::to_hex(table.digest(0)),
+              "a9e96523afa48867198c85f09dff5983");
+    EXPECT_EQ(table.digest(1), table.digest(0));
+  }
+}
+
+TEST_F(FiltersListTest, xxhashProgressiveTest) {
+  // a and b are equal, c differs from them after the first MB, d in the first
+  // 4KB and e is shorter.  f is removed before it is hashed.
+  std::string contents(3 * (1 << 20), 'x');
+  std::vector<FileTable::Index> group = {
+      add(write("a", contents)),
+      add(write("b", contents)),
+      add(write("c", std::string(contents).replace(2 * (1 << 20), 1, "y"))),
+      add(write("d", std::string(contents).replace(10, 1, "y"))),
+      add(write("e", contents.substr(0, 1 << 20))),
+      add(write("f", contents))};
+  fs::remove(dir / "f");
+
+  for (uint64_t threshold : {uint64_t{64 * (1 << 20)}, uint64_t{1}}) {
+    FiltersList::set_mmap_threshold(threshold);
+    EXPECT_EQ(FiltersList::xxhash_progressive(table, group),
+              (FileClasses{{0, 1}}));
+  }
 }
@@ -0,0 +1,58 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "flat_index_map.h"
+
+#include <gtest/gtest.h>
+
+#include <stddef.h>
+#include <string>
+
+class FlatIndexMapTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {}
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {}
+};
+
+TEST_F(FlatIndexMapTest, InsertionOrder) {
+  FlatIndexMap<std::string> map;
+  EXPECT_EQ(map.insert("b"), std::make_pair(0u, true));
+  EXPECT_EQ(map.insert("a"), std::make_pair(1u, true));
+  EXPECT_EQ(map.insert("b"), std::make_pair(0u, false));
+  EXPECT_EQ(map.size(), 2);
+  EXPECT_EQ(map.key(1), "a");
+  EXPECT_EQ(map.find("a"), 1u);
+  EXPECT_EQ(map.find("c"), std::nullopt);
+  EXPECT_EQ(map.size(), 2);
+}
+
+TEST_F(FlatIndexMapTest, Grows) {
+  // Sizes are multiples of the block size, which an identity hash would put
+  // in the same few slots.
+  FlatIndexMap<size_t> map{4};
+  for (size_t i = 0; i < 10000; ++i)
+    EXPECT_EQ(map.insert(i * 4096).first, i);
+  for (size_t i = 0; i < 10000; ++i)
+    EXPECT_EQ(map.insert(i * 4096),
+              std::make_pair(static_cast<uint32_t>(i), false));
+  EXPECT_EQ(map.size(), 10000);
+}
@@ -0,0 +1,203 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#define XXH_PRIVATE_API 0
+#include "hash_cache.h"
+
+#include <fcntl.h>  // for AT_FDCWD
+#include <stdint.h> // for uint64_t
+#include <xxhash.h> // for XXH3_64bits
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "file.h"
+#include "filters_list.h"
+#include "io_stats.h"
+
+namespace fs = std::filesystem;
+
+class HashCacheTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::copy_file("artifacts/sample_1.pdf", dir / "a.pdf");
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {
+    FiltersList::set_hash_cache(nullptr);
+    fs::remove_all(dir);
+  }
+
+  // The key of a file, as the scan would find it.
+  static std::optional<HashCache::Key> key_of(const fs::path &path) {
+    File file{path.string()};
+    const std::optional<FileStat> &st = file.get_stat();
+    if (!st)
+      return std::nullopt;
+    return HashCache::key_for(*st);
+  }
+
+  FileTable::Index add(const fs::path &path) {
+    return table.add(path.string(),
+                     *stat_at(AT_FDCWD, path.string().c_str(), 0));
+  }
+
+  fs::path dir = fs::temp_directory_path() / "undupes_hash_cache_test";
+  fs::path cache_path = dir / "cache";
+  FileTable table;
+};
+
+TEST_F(HashCacheTest, StoreAndReload) {
+  auto key = key_of(dir / "a.pdf");
+  ASSERT_TRUE(key.has_value());
+  {
+    HashCache cache{cache_path.string()};
+    EXPECT_FALSE(cache.lookup(*key, HashCache::Kind::full));
+    cache.store(*key, HashCache::Kind::full, HashCache::Digest{1, 2});
+    auto digest = cache.lookup(*key, HashCache::Kind::full);
+    ASSERT_TRUE(digest.has_value());
+    EXPECT_EQ(digest->low64, 1);
+    EXPECT_FALSE(cache.lookup(*key, HashCache::Kind::head));
+    cache.save();
+  }
+  HashCache cache{cache_path.string()};
+  EXPECT_EQ(cache.size(), 1);
+  auto digest = cache.lookup(*key, HashCache::Kind::full);
+  ASSERT_TRUE(digest.has_value());
+  EXPECT_EQ(digest->low64, 1);
+  EXPECT_EQ(digest->high64, 2);
+  EXPECT_EQ(cache.hits(), 1);
+}
+
+TEST_F(HashCacheTest, ChangedFileIsDropped) {
+  auto key = key_of(dir / "a.pdf");
+  {
+    HashCache cache{cache_path.string()};
+    cache.store(*key, HashCache::Kind::head, HashCache::Digest{3, 4});
+    cache.save();
+  }
+  std::ofstream{dir / "a.pdf", std::ios::app} << "changed";
+  auto new_key = key_of(dir / "a.pdf");
+  {
+    HashCache cache{cache_path.string()};
+    EXPECT_FALSE(cache.lookup(*new_key, HashCache::Kind::head));
+    cache.save();
+  }
+  HashCache cache{cache_path.string()};
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST_F(HashCacheTest, CorruptCacheIsRebuilt) {
+  std::ofstream{cache_path} << "definitely not a hash cache";
+  auto key = key_of(dir / "a.pdf");
+  {
+    HashCache cache{cache_path.string()};
+    EXPECT_EQ(cache.size(), 0);
+    cache.store(*key, HashCache::Kind::full, HashCache::Digest{5, 6});
+    cache.save();
+  }
+  HashCache cache{cache_path.string()};
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(HashCacheTest, OverflowingCountIsRejected) {
+  // One record, with a count which times the record size wraps around to it.
+  struct {
+    char magic[8] = {'U', 'N', 'D', 'U', 'P', 'E', 'S', 'C'};
+    uint32_t version = 2;
+    uint32_t record_size = 64;
+    uint64_t count = 1 + (uint64_t{1} << 58);
+    uint64_t checksum = 0;
+  } header;
+  char record[64] = {};
+  header.checksum = XXH3_64bits(record, sizeof(record));
+  {
+    std::ofstream out{cache_path, std::ios::binary};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(record, sizeof(record));
+  }
+  HashCache cache{cache_path.string()};
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST_F(HashCacheTest, FiltersListUsesCache) {
+  fs::copy_file(dir / "a.pdf", dir / "b.pdf");
+  std::vector<FileTable::Index> group = {add(dir / "a.pdf"),
+                                         add(dir / "b.pdf")};
+  {
+    HashCache cache{cache_path.string()};
+    FiltersList::set_hash_cache(&cache);
+    EXPECT_EQ(FiltersList::xxhash_progressive(table, group),
+              (FileClasses{{0, 1}}));
+    EXPECT_EQ(FiltersList::to_hex(table.digest(0)),
+              "a9e96523afa48867198c85f09dff5983");
+    EXPECT_GT(cache.misses(), 0);
+    cache.save();
+  }
+  HashCache cache{cache_path.string()};
+  FiltersList::set_hash_cache(&cache);
+  table.set_digest(0, Hash128{});
+  EXPECT_EQ(FiltersList::xxhash_progressive(table, group),
+            (FileClasses{{0, 1}}));
+  EXPECT_EQ(FiltersList::to_hex(table.digest(0)),
+            "a9e96523afa48867198c85f09dff5983");
+  EXPECT_EQ(cache.misses(), 0);
+  EXPECT_GT(cache.hits(), 0);
+}
+
+TEST_F(HashCacheTest, ProgressiveRerunReadsNothing) {
+  // b is a copy of a, c differs from it in the first 4KB, d after 16KB and e
+  // after 1MB, so they drop out in different rounds.
+  std::string contents(3 * (1 << 20), 'x');
+  std::vector<FileTable::Index> group;
+  for (auto [name, at] : {std::pair{"a", size_t{0}}, std::pair{"b", size_t{0}},
+                          std::pair{"c", size_t{10}},
+                          std::pair{"d", size_t{16 << 10}},
+                          std::pair{"e", size_t{(1 << 20) + 1}}}) {
+    std::string data = contents;
+    if (at != 0)
+      data.at(at) = 'y';
+    std::ofstream{dir / name, std::ios::binary} << data;
+    group.push_back(add(dir / name));
+  }
+
+  auto bytes_read = []() { return IOStats::snapshot().bytes_read; };
+  for (int run = 0; run < 2; ++run) {
+    HashCache cache{cache_path.string()};
+    FiltersList::set_hash_cache(&cache);
+    uint64_t before = bytes_read();
+    EXPECT_EQ(FiltersList::xxhash_progressive(table, group),
+              (FileClasses{{0, 1}}));
+    if (run == 0)
+      EXPECT_GT(bytes_read(), before);
+    else
+      EXPECT_EQ(bytes_read(), before);
+    cache.save();
+    FiltersList::set_hash_cache(nullptr);
+  }
+}
@@ -376,12 +376,6 @@ TEST_F(IOTest, ParseInputTest) {
       F("artifacts/dir_4/a/d"),
   };
 
-  auto cin_buff = std::cin.rdbuf();
-  // find artifacts f,l -print0 >
-  // /home/chaturvedi/workspace/undupes/tests/io/parse_input.in
-  std::ifstream tty_in("io/parse_input.in");
-  std::cin.rdbuf(tty_in.rdbuf());
-
   {
     std::shared_ptr<spdlog::logger> bt_spdlog =
         spdlog::basic_logger_mt("basic_logger", "spdlog.txt");
@@ -389,10 +383,11 @@ TEST_F(IOTest, ParseInputTest) {
     spdlog::flush_on(spdlog::level::warn);
     spdlog::set_default_logger(bt_spdlog);
     // redirecting stdout to a file doesn't work.
-    IO::parse_input(file_sets);
+    FileTable table;
+    IndexGroups groups;
+    IO::parse_input(table, groups, nullptr, "io/parse_input.in");
     IO::end_animation();
-    std::cin.rdbuf(cin_buff);
-    tty_in.close();
+    file_sets = to_file_sets(table, groups);
     spdlog::set_default_logger(prev_logger);
   }
 
@@ -430,6 +425,26 @@ TEST_F(IOTest, ParseInputTest) {
   EXPECT_EQ(file_sets, artifacts_file_sets);
 }
 
+TEST_F(IOTest, ParseInputTableTest) {
+  auto parse = [](ThreadPool *pool) {
+    FileTable table;
+    IndexGroups groups;
+    IO::parse_input(table, groups, pool, "io/parse_input.in");
+    IO::end_animation();
+    std::vector<std::string> paths;
+    for (FileTable::Index i : groups[0])
+      paths.push_back(table.path(i));
+    return paths;
+  };
+  // The workers split the input into runs, the paths still come out in input
+  // order.
+  std::vector<std::string> expected = parse(nullptr);
+  ASSERT_FALSE(expected.empty());
+  ThreadPool pool{4};
+  for (int i = 0; i < 10; ++i)
+    EXPECT_EQ(parse(&pool), expected);
+}
+
 TEST_F(IOTest, ShowFileListTest) {
   EXPECT_EQ(file_sets_dir_3.size(), 1);
 
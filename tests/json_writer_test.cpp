@@ -0,0 +1,80 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "json_writer.h"
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class JsonWriterTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    for (const char *path : {"a/b", "a/c", "quote\"d", "tab\there", "ü/x"})
+      set.push_back(table.add(path, FileStat{}));
+  }
+
+  FileTable table;
+  std::vector<FileTable::Index> set;
+};
+
+TEST_F(JsonWriterTest, MatchesDump) {
+  std::ostringstream out;
+  JsonSetWriter writer{out, JsonSetWriter::Format::json};
+  writer.write(table, set);
+  writer.write(table, std::span{set}.first(1));
+  writer.write(table, std::span{set}.first(2), true);
+  writer.finish();
+  EXPECT_EQ(writer.num_sets(), 2);
+
+  nlohmann::json expected;
+  expected.push_back(
+      {{"file_list", {"a/b", "a/c", "quote\"d", "tab\there", "ü/x"}}});
+  expected.push_back({{"file_list", {"a/b", "a/c"}}, {"same_inode", true}});
+  EXPECT_EQ(out.str(), expected.dump(4) + "\n");
+}
+
+TEST_F(JsonWriterTest, NoSets) {
+  std::ostringstream out;
+  JsonSetWriter writer{out, JsonSetWriter::Format::json};
+  writer.finish();
+  EXPECT_EQ(out.str(), nlohmann::json{}.dump(4) + "\n");
+}
+
+TEST_F(JsonWriterTest, NDJSON) {
+  std::ostringstream out;
+  JsonSetWriter writer{out, JsonSetWriter::Format::ndjson};
+  writer.write(table, std::span{set}.first(2));
+  writer.write(table, std::span{set}.subspan(2), true);
+  writer.finish();
+  std::istringstream lines{out.str()};
+  std::string line;
+  std::vector<nlohmann::json> objects;
+  while (std::getline(lines, line))
+    objects.push_back(nlohmann::json::parse(line));
+  ASSERT_EQ(objects.size(), 2);
+  EXPECT_EQ(objects.at(0)["file_list"].size(), 2);
+  EXPECT_FALSE(objects.at(0).contains("same_inode"));
+  EXPECT_EQ(objects.at(1)["file_list"][1], "tab\there");
+  EXPECT_EQ(objects.at(1)["same_inode"], true);
+}
@@ -0,0 +1,137 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "async_reader.h"
+#include "mmap_reader.h"
+
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace {
+// MmapReader::read_file with a lambda for the callback.
+template <class OnBlock>
+bool read_file(const std::string &path, uint64_t limit, OnBlock on_block,
+               size_t window_size = MmapReader::default_window_size) {
+  return MmapReader::read_file(
+      path, limit,
+      [](void *context, const unsigned char *data, size_t size) {
+        (*static_cast<OnBlock *>(context))(data, size);
+      },
+      &on_block, window_size);
+}
+} // namespace
+
+class MmapReaderTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    temp_file = std::filesystem::temp_directory_path() /
+                ("undupes_mmap_reader_test_" + std::to_string(getpid()));
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { std::filesystem::remove(temp_file); }
+
+  std::string contents_of(const std::string &path) {
+    std::ifstream in{path, std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>{in}, {}};
+  }
+
+  std::filesystem::path temp_file;
+};
+
+TEST_F(MmapReaderTest, ReadsInWindows) {
+  const std::string path = "artifacts/sample_1.pdf";
+  std::string expected = contents_of(path);
+  for (uint64_t limit : {uint64_t{0}, uint64_t{4096}, uint64_t{10000}}) {
+    std::string contents;
+    size_t windows{0};
+    EXPECT_TRUE(read_file(
+        path, limit,
+        [&](const unsigned char *data, size_t size) {
+          contents.append(reinterpret_cast<const char *>(data), size);
+          ++windows;
+        },
+        4096));
+    EXPECT_EQ(contents, limit == 0 ? expected : expected.substr(0, limit));
+    EXPECT_EQ(windows, (contents.size() + 4095) / 4096);
+  }
+}
+
+TEST_F(MmapReaderTest, MissingFile) {
+  EXPECT_FALSE(read_file("artifacts/non_existent_file", 0,
+                         [](const unsigned char *, size_t) {}));
+}
+
+TEST_F(MmapReaderTest, TruncatedWhileReading) {
+  {
+    std::ofstream out{temp_file, std::ios::binary};
+    out << std::string(4 * 4096, 'x');
+  }
+  // The file shrinks after the first window is mapped, touching the later
+  // windows raises SIGBUS which must turn into a failed read.
+  size_t windows{0};
+  unsigned char sum{0};
+  EXPECT_FALSE(read_file(
+      temp_file, 0,
+      [&](const unsigned char *data, size_t size) {
+        if (windows++ == 0)
+          std::filesystem::resize_file(temp_file, 0);
+        for (size_t i = 0; i < size; ++i)
+          sum += data[i];
+      },
+      4096));
+  EXPECT_EQ(windows, 1);
+}
+
+TEST_F(MmapReaderTest, ForeignSigbusIsPassedOn) {
+  auto read_truncating = [this]() {
+    std::ofstream{temp_file, std::ios::binary} << std::string(4 * 4096, 'x');
+    size_t windows{0};
+    unsigned char sum{0};
+    return read_file(
+        temp_file, 0,
+        [&](const unsigned char *data, size_t size) {
+          if (windows++ == 0)
+            std::filesystem::resize_file(temp_file, 0);
+          for (size_t i = 0; i < size; ++i)
+            sum += data[i];
+        },
+        4096);
+  };
+  // A SIGBUS outside a read goes to the handler installed before the reader's
+  // and the reader still catches the next truncation.
+  auto child = [&]() {
+    static volatile sig_atomic_t caught{0};
+    signal(SIGBUS, [](int) { caught = caught + 1; });
+    bool ok = read_truncating();
+    raise(SIGBUS);
+    bool ok_after = read_truncating();
+    exit(!ok && !ok_after && caught == 1 ? 0 : 1);
+  };
+  // A fresh process, so the reader installs its handler over ours.
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  EXPECT_EXIT(child(), testing::ExitedWithCode(0), "");
+}
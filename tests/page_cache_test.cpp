@@ -0,0 +1,102 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "page_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+class PageCacheTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    std::ifstream in{path, std::ios::binary};
+    contents.assign(std::istreambuf_iterator<char>{in}, {});
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { PageCache::set_bypass(false); }
+
+  // The file read from `offset` on with PageCache::pread, a page at a time.
+  std::string read_from(uint64_t offset) {
+    int fd = PageCache::open(path.c_str());
+    EXPECT_GE(fd, 0);
+    PageCache::Buffer buffer{PageCache::alignment};
+    std::string result;
+    ssize_t r;
+    while ((r = PageCache::pread(fd, buffer.data(), buffer.size(), offset)) >
+           0) {
+      result.append(reinterpret_cast<const char *>(buffer.data()),
+                    static_cast<size_t>(r));
+      offset += static_cast<uint64_t>(r);
+    }
+    EXPECT_EQ(r, 0);
+    PageCache::close(fd);
+    return result;
+  }
+
+  std::string path = "artifacts/sample_1.pdf";
+  std::string contents;
+};
+
+TEST_F(PageCacheTest, Buffers) {
+  unsigned char *first;
+  {
+    PageCache::Buffer buffer{1000};
+    EXPECT_EQ(buffer.size(), PageCache::alignment);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.data()) %
+                  PageCache::alignment,
+              0);
+    first = buffer.data();
+  }
+  // Given back and taken again.
+  PageCache::Buffer again{PageCache::alignment};
+  EXPECT_EQ(again.data(), first);
+
+  PageCache::Buffer huge{3 * (1 << 20)};
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(huge.data()) % PageCache::alignment, 0);
+  huge.data()[huge.size() - 1] = 1;
+}
+
+TEST_F(PageCacheTest, ReadsTheSameData) {
+  ASSERT_GT(contents.size(), 2 * PageCache::alignment);
+  EXPECT_EQ(read_from(0), contents);
+  PageCache::set_bypass(true);
+  EXPECT_EQ(read_from(0), contents);
+  // Unaligned reads fall back to the page cache.
+  EXPECT_EQ(read_from(100), contents.substr(100));
+}
+
+TEST_F(PageCacheTest, SequentialReads) {
+  PageCache::set_bypass(true);
+  int fd = PageCache::open(path.c_str());
+  ASSERT_GE(fd, 0);
+  PageCache::Buffer buffer{contents.size()};
+  size_t total = 0;
+  for (ssize_t r; (r = PageCache::read(fd, buffer.data() + total,
+                                       buffer.size() - total)) > 0;)
+    total += static_cast<size_t>(r);
+  PageCache::close(fd);
+  EXPECT_EQ(std::string(reinterpret_cast<const char *>(buffer.data()), total),
+            contents);
+}
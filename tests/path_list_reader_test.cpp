@@ -0,0 +1,141 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "path_list_reader.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>    // for fileno, popen
+#include <sys/stat.h> // for mkfifo
+#include <unistd.h>   // for dup, dup2
+
+#include <filesystem>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class PathListReaderTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {}
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { fs::remove(list_path); }
+
+  void write_list(const std::string &data) {
+    std::ofstream out{list_path, std::ios::binary};
+    out << data;
+  }
+
+  static std::vector<std::string> read_all(PathListReader &reader,
+                                           size_t max_paths) {
+    std::vector<std::string> paths;
+    std::vector<PathListReader::Chunk> chunks;
+    PathListReader::Chunk chunk;
+    while (reader.next(chunk, max_paths)) {
+      EXPECT_LE(chunk.paths.size(), max_paths);
+      for (auto path : chunk.paths) {
+        // Every path is NUL terminated in place.
+        EXPECT_EQ(path.data()[path.size()], '\0');
+        paths.emplace_back(path);
+      }
+      chunks.push_back(chunk);
+    }
+    // The views of earlier chunks are still valid.
+    size_t i = 0;
+    for (const auto &c : chunks)
+      for (auto path : c.paths)
+        EXPECT_EQ(path, paths.at(i++));
+    return paths;
+  }
+
+  fs::path list_path = fs::temp_directory_path() / "undupes_path_list_test";
+};
+
+TEST_F(PathListReaderTest, MappedFile) {
+  write_list(std::string("a\0b/c\0\0d", 8));
+  PathListReader reader{list_path.string()};
+  EXPECT_TRUE(reader.is_mapped());
+  EXPECT_EQ(read_all(reader, 2),
+            (std::vector<std::string>{"a", "b/c", "", "d"}));
+}
+
+TEST_F(PathListReaderTest, Pipe) {
+  // Enough paths to go over several blocks.
+  std::vector<std::string> expected;
+  std::string data;
+  for (int i = 0; i < 100000; ++i) {
+    expected.push_back("some/directory/file_" + std::to_string(i));
+    data += expected.back() + '\0';
+  }
+  write_list(data);
+
+  FILE *pipe = popen(("cat " + list_path.string()).c_str(), "r");
+  ASSERT_NE(pipe, nullptr);
+  int saved_stdin = dup(0);
+  dup2(fileno(pipe), 0);
+  {
+    PathListReader reader;
+    EXPECT_FALSE(reader.is_mapped());
+    EXPECT_EQ(read_all(reader, 1000), expected);
+  }
+  dup2(saved_stdin, 0);
+  close(saved_stdin);
+  pclose(pipe);
+}
+
+TEST_F(PathListReaderTest, SlowPipe) {
+  // The paths written so far are handed out without waiting for a full block
+  // or the end of the list.
+  ASSERT_EQ(mkfifo(list_path.c_str(), 0600), 0);
+  std::promise<void> release;
+  std::thread writer([this, done = release.get_future()]() {
+    std::ofstream out{list_path, std::ios::binary};
+    out << std::string("a\0b\0", 4) << std::flush;
+    done.wait();
+    out << std::string("c\0", 2);
+  });
+  PathListReader reader{list_path.string()};
+  PathListReader::Chunk chunk;
+  auto first = std::async(std::launch::async, [&reader, &chunk]() {
+    return reader.next(chunk, 100);
+  });
+  bool ready =
+      first.wait_for(std::chrono::seconds(2)) == std::future_status::ready;
+  release.set_value();
+  EXPECT_TRUE(ready);
+  EXPECT_TRUE(first.get());
+  EXPECT_EQ(std::vector<std::string>(chunk.paths.begin(), chunk.paths.end()),
+            (std::vector<std::string>{"a", "b"}));
+  writer.join();
+  EXPECT_TRUE(reader.next(chunk, 100));
+  EXPECT_EQ(std::vector<std::string>(chunk.paths.begin(), chunk.paths.end()),
+            (std::vector<std::string>{"c"}));
+  EXPECT_FALSE(reader.next(chunk, 100));
+}
+
+TEST_F(PathListReaderTest, MissingFile) {
+  EXPECT_THROW(PathListReader{"/nonexistent/undupes/list"},
+               std::runtime_error);
+}
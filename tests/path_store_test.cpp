@@ -0,0 +1,60 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "path_store.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+class PathStoreTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {}
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {}
+};
+
+TEST_F(PathStoreTest, RoundTrip) {
+  std::vector<std::string> paths = {
+      "a",     "/a",       "a/b",        "/a/b/c", "a/b/c",     "a//b",
+      "./a/b", "../x/./y", "/a/b/c/d/e", "a/",     "a/b/c.txt", ""};
+  PathStore store;
+  for (const auto &path : paths)
+    store.add(path);
+  ASSERT_EQ(store.size(), paths.size());
+  for (size_t i = 0; i < paths.size(); ++i)
+    EXPECT_EQ(store.path(i), paths.at(i));
+
+  std::string out = "x";
+  store.append_path(3, out);
+  EXPECT_EQ(out, "x/a/b/c");
+}
+
+TEST_F(PathStoreTest, SharedDirectories) {
+  PathStore store;
+  std::string long_dir(5000, 'd');
+  for (int i = 0; i < 1000; ++i)
+    store.add("/archive/" + long_dir + "/" + std::to_string(i));
+  // "", "archive" and the long one.
+  EXPECT_EQ(store.num_dirs(), 3);
+  EXPECT_EQ(store.path(999), "/archive/" + long_dir + "/999");
+}
@@ -0,0 +1,171 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "bin_compare_files.h"
+#include "device_profile.h"
+#include "file.h"
+#include "filter.h"
+#include "filters_list.h"
+
+namespace fs = std::filesystem;
+
+class PipelineTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    std::vector<std::string> paths;
+    for (const auto &entry : fs::directory_iterator("artifacts/dir_3"))
+      if (entry.is_regular_file())
+        paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+    std::vector<FileTable::Index> group;
+    for (const auto &path : paths)
+      group.push_back(table.add(path, *File{path}.get_stat()));
+    IndexGroups groups;
+    groups.add(group);
+    TableHashableFilter by_size{
+        table, groups,
+        [](const FileTable &t, FileTable::Index i) { return t.file_size(i); }};
+    size_groups = std::move(by_size.new_groups);
+  }
+
+  std::vector<std::vector<FileTable::Index>> run(ThreadPool *pool,
+                                                 bool compare = true) {
+    std::vector<std::vector<FileTable::Index>> sets;
+    Pipeline::run(table, size_groups, pool, compare,
+                  [&sets](std::span<const FileTable::Index> set) {
+                    sets.emplace_back(set.begin(), set.end());
+                  });
+    return sets;
+  }
+
+  // The sets in a fixed order, for the runs which pass them on in the order
+  // they are confirmed.
+  static std::vector<std::vector<FileTable::Index>>
+  sorted(std::vector<std::vector<FileTable::Index>> sets) {
+    std::sort(sets.begin(), sets.end());
+    return sets;
+  }
+
+  FileTable table;
+  IndexGroups size_groups;
+};
+
+TEST_F(PipelineTest, MatchesTheStages) {
+  // The stages one after the other: every size group is split by its
+  // digests, then every class of equal digests by its contents.
+  std::vector<std::vector<FileTable::Index>> expected;
+  for (size_t g = 0; g < size_groups.size(); ++g) {
+    std::span<const FileTable::Index> group = size_groups[g];
+    for (const auto &hashed : FiltersList::xxhash_progressive(table, group)) {
+      std::vector<std::string> paths;
+      for (auto i : hashed)
+        paths.push_back(table.path(group[i]));
+      for (const auto &same : compare_files_lockstep(paths)) {
+        if (same.size() < 2)
+          continue;
+        expected.emplace_back();
+        for (auto j : same)
+          expected.back().push_back(group[hashed.at(j)]);
+      }
+    }
+  }
+  std::vector<std::vector<std::string>> expected_paths;
+  for (const auto &set : expected) {
+    expected_paths.emplace_back();
+    for (FileTable::Index i : set)
+      expected_paths.back().push_back(fs::path(table.path(i)).filename());
+  }
+  EXPECT_EQ(expected_paths,
+            (std::vector<std::vector<std::string>>{
+                {"1KB_1", "1KB_1.copy.1", "1KB_1.copy.2", "1KB_1.copy.3"},
+                {"1KB_2", "1KB_2.copy.1", "1KB_2.copy.2", "1KB_2.copy.3"},
+                {"3KB_1", "3KB_1.copy.1", "3KB_1.copy.2", "3KB_1.copy.3"},
+                {"4KB_1", "4KB_1.copy.1", "4KB_1.copy.2", "4KB_1.copy.3",
+                 "4KB_1.copy.4", "4KB_1.copy.5"}}));
+
+  // Without a pool the sets come out in group order, with one in the order
+  // the workers confirm them.
+  EXPECT_EQ(run(nullptr), expected);
+  ThreadPool pool{4};
+  for (int i = 0; i < 10; ++i)
+    EXPECT_EQ(sorted(run(&pool)), sorted(expected));
+  EXPECT_EQ(sorted(run(&pool, false)), sorted(expected));
+
+  // Reading the files backwards changes nothing in the sets.
+  table.init_read_keys();
+  for (FileTable::Index i = 0; i < table.size(); ++i)
+    table.set_read_key(i, table.size() - i);
+  EXPECT_EQ(sorted(run(nullptr)), sorted(expected));
+  EXPECT_EQ(sorted(run(&pool)), sorted(expected));
+
+  // Nor does a spinning disk, verifying a group at a time in large blocks.
+  DeviceProfiles::set(table.dev(0), DeviceProfile::for_kind(
+                                        DeviceProfile::Kind::rotational));
+  EXPECT_EQ(sorted(run(&pool)), sorted(expected));
+  DeviceProfiles::set(table.dev(0), DeviceProfile::for_kind(
+                                        DeviceProfile::Kind::network));
+  EXPECT_EQ(sorted(run(&pool)), sorted(expected));
+  DeviceProfiles::set(table.dev(0), DeviceProfile::for_kind(
+                                        DeviceProfile::Kind::solid_state));
+}
+
+TEST_F(PipelineTest, SplitsLargeGroups) {
+  // One size group of 1100 files, large enough to be spread over the pool,
+  // with 300 sets of duplicates.  Some of the heads are known beforehand.
+  fs::path dir = fs::temp_directory_path() /
+                 ("undupes_pipeline_test_" + std::to_string(getpid()));
+  fs::create_directories(dir);
+  table = FileTable{};
+  std::vector<FileTable::Index> group;
+  for (size_t i = 0; i < 1100; ++i) {
+    std::string path = (dir / std::to_string(i)).string();
+    std::string contents = std::to_string(i % 300);
+    contents.resize(100, 'x');
+    std::ofstream{path, std::ios::binary} << contents;
+    group.push_back(table.add(path, *File{path}.get_stat()));
+  }
+  size_groups = IndexGroups{};
+  size_groups.add(group);
+  DeviceProfiles::set(table.dev(0), DeviceProfile::for_kind(
+                                        DeviceProfile::Kind::solid_state));
+
+  std::vector<std::vector<FileTable::Index>> expected = run(nullptr);
+  EXPECT_EQ(expected.size(), 300);
+  for (FileTable::Index i = 0; i < 100; ++i)
+    table.set_head(i, *FiltersList::xxhash_heads({table.path(i)}).at(0));
+  ThreadPool pool{4};
+  for (int i = 0; i < 3; ++i)
+    EXPECT_EQ(sorted(run(&pool)), sorted(expected));
+  EXPECT_EQ(sorted(run(&pool, false)), sorted(expected));
+  fs::remove_all(dir);
+}
@@ -0,0 +1,77 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "read_order.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "file.h"
+
+namespace fs = std::filesystem;
+
+class ReadOrderTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::vector<FileTable::Index> group;
+    for (const char *name : {"c", "a", "b", "d"}) {
+      std::string path = (dir / name).string();
+      std::ofstream{path} << std::string(8192, *name);
+      group.push_back(table.add(path, *File{path}.get_stat()));
+    }
+    groups.add(group);
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { fs::remove_all(dir); }
+
+  fs::path dir = fs::temp_directory_path() / "undupes_read_order_test";
+  FileTable table;
+  IndexGroups groups;
+};
+
+TEST_F(ReadOrderTest, AssignsKeys) {
+  EXPECT_FALSE(table.has_read_keys());
+  ThreadPool pool{2};
+  ReadOrder::assign_keys(table, groups, &pool);
+  ASSERT_TRUE(table.has_read_keys());
+  for (FileTable::Index i : groups[0]) {
+    auto extent = ReadOrder::first_extent(table.path(i).c_str());
+    EXPECT_EQ(table.read_key(i), extent.value_or(ReadOrder::unknown));
+  }
+}
+
+TEST_F(ReadOrderTest, Ranks) {
+  table.init_read_keys();
+  table.set_read_key(0, 300);
+  table.set_read_key(1, 100);
+  table.set_read_key(3, 200);
+  // File 2 has no known extent and goes last.
+  EXPECT_EQ(ReadOrder::ranks(table, groups[0]),
+            (std::vector<size_t>{2, 0, 3, 1}));
+  EXPECT_TRUE(ReadOrder::before(table, 1, 0));
+  EXPECT_FALSE(ReadOrder::before(table, 2, 3));
+}
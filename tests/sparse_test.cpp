@@ -0,0 +1,154 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "sparse.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "async_reader.h"
+#include "bin_compare_files.h"
+#include "io_stats.h"
+#include "mmap_reader.h"
+
+namespace fs = std::filesystem;
+
+class SparseTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    dir = fs::temp_directory_path() / "undupes_sparse_test";
+    fs::create_directories(dir);
+    // 8MB with 4KB of data at 1MB and at 5MB, and holes around them.
+    std::string data(4096, 'x');
+    sparse = (dir / "sparse").string();
+    {
+      std::ofstream out{sparse, std::ios::binary};
+      out.seekp(1 << 20);
+      out << data;
+      out.seekp(5 << 20);
+      out << data;
+    }
+    fs::resize_file(sparse, 8 << 20);
+    dense = (dir / "dense").string();
+    std::string contents(8 << 20, '\0');
+    contents.replace(1 << 20, data.size(), data);
+    contents.replace(5 << 20, data.size(), data);
+    std::ofstream{dense, std::ios::binary} << contents;
+    other = (dir / "other").string();
+    contents.at(7 << 20) = 'y';
+    std::ofstream{other, std::ios::binary} << contents;
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { fs::remove_all(dir); }
+
+  bool has_holes() {
+    int fd = open(sparse.c_str(), O_RDONLY);
+    bool result = Sparse::Extents{fd}.sparse() &&
+                  Sparse::Extents{fd}.hole(0, UINT64_MAX) == (1 << 20);
+    close(fd);
+    return result;
+  }
+
+  std::string read_whole(AsyncReader &reader, const std::string &path) {
+    std::string contents;
+    std::vector<bool> ok;
+    reader.read_files(
+        {path}, 0,
+        [&contents](size_t, const unsigned char *data, size_t size) {
+          contents.append(reinterpret_cast<const char *>(data), size);
+        },
+        ok);
+    EXPECT_TRUE(ok.at(0));
+    return contents;
+  }
+
+  fs::path dir;
+  std::string sparse, dense, other;
+};
+
+TEST_F(SparseTest, Extents) {
+  if (!has_holes())
+    GTEST_SKIP() << "The filesystem does not keep holes.";
+  int fd = open(sparse.c_str(), O_RDONLY);
+  Sparse::Extents extents{fd};
+  EXPECT_EQ(extents.hole(0, UINT64_MAX), 1 << 20);
+  EXPECT_EQ(extents.hole(100, 4096), 4096 - 100);
+  EXPECT_EQ(extents.hole(1 << 20, UINT64_MAX), 0);
+  EXPECT_GE(extents.data_end(1 << 20), (1 << 20) + 4096);
+  EXPECT_LT(extents.data_end(1 << 20), 5 << 20);
+  // The hole at the end runs to the end of the file, not to `end`.
+  EXPECT_EQ(extents.hole(6 << 20, UINT64_MAX), 2 << 20);
+  EXPECT_EQ(extents.hole(8 << 20, UINT64_MAX), 0);
+  close(fd);
+
+  int dense_fd = open(dense.c_str(), O_RDONLY);
+  Sparse::Extents dense_extents{dense_fd};
+  EXPECT_EQ(dense_extents.hole(0, UINT64_MAX), 0);
+  EXPECT_EQ(dense_extents.data_end(0), UINT64_MAX);
+  close(dense_fd);
+}
+
+TEST_F(SparseTest, ReadersSeeZeros) {
+  std::unique_ptr<AsyncReader> uring = AsyncReader::create(8, 64 << 10);
+  PreadReader pread_reader{64 << 10};
+  PreadReader dense_reader{64 << 10};
+  std::string expected = read_whole(dense_reader, dense);
+
+  IOStats::Counters before = IOStats::snapshot();
+  EXPECT_EQ(read_whole(pread_reader, sparse), expected);
+  EXPECT_EQ(read_whole(*uring, sparse), expected);
+  std::string mapped;
+  EXPECT_TRUE(MmapReader::read_file(
+      sparse, 0,
+      [](void *context, const unsigned char *data, size_t size) {
+        static_cast<std::string *>(context)->append(
+            reinterpret_cast<const char *>(data), size);
+      },
+      &mapped));
+  EXPECT_EQ(mapped, expected);
+  if (has_holes()) {
+    EXPECT_LT((IOStats::snapshot() - before).bytes_read, 3 * (1 << 20));
+  }
+}
+
+TEST_F(SparseTest, Compare) {
+  FileClasses expected = {{0, 1}, {2}};
+  EXPECT_EQ(compare_files_lockstep({sparse, dense, other}), expected);
+  EXPECT_EQ(compare_files_lockstep({sparse, sparse, other}),
+            (FileClasses{{0, 1}, {2}}));
+  EXPECT_TRUE(compare_files_fdupes(sparse, dense));
+  EXPECT_TRUE(compare_files_fdupes(sparse, sparse));
+  EXPECT_FALSE(compare_files_fdupes(sparse, other));
+
+  // Two sparse files only read their data.
+  if (!has_holes())
+    return;
+  IOStats::Counters before = IOStats::snapshot();
+  EXPECT_TRUE(compare_files_fdupes(sparse, sparse));
+  EXPECT_LT((IOStats::snapshot() - before).bytes_read, 1 << 20);
+}
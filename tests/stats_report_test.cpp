@@ -0,0 +1,83 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "stats_report.h"
+
+#include <fcntl.h> // for AT_FDCWD
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "bin_compare_files.h"
+#include "file.h"
+
+namespace fs = std::filesystem;
+
+class StatsReportTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    for (const char *name : {"a", "b"}) {
+      std::string path = (dir / name).string();
+      std::ofstream{path} << std::string(1000, 'x');
+      group.push_back(table.add(path, *stat_at(AT_FDCWD, path.c_str(), 0)));
+    }
+    groups.add(group);
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { fs::remove_all(dir); }
+
+  fs::path dir = fs::temp_directory_path() / "undupes_stats_report_test";
+  FileTable table;
+  std::vector<FileTable::Index> group;
+  IndexGroups groups;
+};
+
+TEST_F(StatsReportTest, CountsTheIOOfAStage) {
+  StatsReport stats;
+  stats.start("compare", table, groups);
+  FileClasses classes =
+      compare_files_lockstep({table.path(0), table.path(1)});
+  IndexGroups out;
+  out.add(group);
+  stats.stop(out);
+  ASSERT_EQ(classes.size(), 1);
+
+  ASSERT_EQ(stats.stages().size(), 1);
+  const auto &stage = stats.stages().front();
+  EXPECT_EQ(stage.name, "compare");
+  EXPECT_EQ(stage.files_in, 2);
+  EXPECT_EQ(stage.groups_out, 1);
+  EXPECT_EQ(stage.bytes_in, 2000);
+  EXPECT_EQ(stage.io.opens, 2);
+  EXPECT_EQ(stage.io.bytes_read, 2000);
+  EXPECT_GE(stage.wall_ms, 0);
+
+  auto json = nlohmann::json::parse(stats.to_json());
+  EXPECT_EQ(json["stages"][0]["name"], "compare");
+  EXPECT_EQ(json["stages"][0]["read_amplification"], 1.0);
+}
@@ -0,0 +1,68 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+class ThreadPoolTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {}
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override {}
+};
+
+TEST_F(ThreadPoolTest, RunsAllTasks) {
+  ThreadPool pool{4};
+  std::vector<int> done(1000, 0);
+  for (size_t i = 0; i < done.size(); ++i)
+    pool.submit([&done, i]() { done.at(i) = 1; });
+  pool.wait();
+  for (const auto &d : done)
+    EXPECT_EQ(d, 1);
+}
+
+TEST_F(ThreadPoolTest, NestedSubmit) {
+  ThreadPool pool{3};
+  std::atomic<int> count{0};
+  for (int i = 0; i < 10; ++i)
+    pool.submit([&pool, &count]() {
+      for (int j = 0; j < 10; ++j)
+        pool.submit([&count]() { ++count; });
+    });
+  pool.wait();
+  EXPECT_EQ(count.load(), 100);
+}
+
+TEST_F(ThreadPoolTest, RethrowsException) {
+  ThreadPool pool{2};
+  pool.submit([]() { throw std::runtime_error("task failed"); });
+  EXPECT_THROW(pool.wait(), std::runtime_error);
+  // The pool is usable after an exception has been reported.
+  std::atomic<int> count{0};
+  pool.submit([&count]() { ++count; });
+  pool.wait();
+  EXPECT_EQ(count.load(), 1);
+}
@@ -0,0 +1,116 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "throttle.h"
+
+#include <gtest/gtest.h>
+#include <signal.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+class ThrottleTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override { Throttle::set_limits({}); }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { Throttle::set_limits({}); }
+
+  // Seconds taken by `reads` reads of `bytes` bytes.
+  double time_reads(size_t reads, size_t bytes) {
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < reads; ++i)
+      Throttle::account(bytes);
+    return duration<double>(steady_clock::now() - start).count();
+  }
+};
+
+TEST_F(ThrottleTest, Unlimited) { EXPECT_LT(time_reads(100000, 1 << 20), 1); }
+
+TEST_F(ThrottleTest, Iops) {
+  Throttle::set_limits({0, 200});
+  // The first read is free, the other 40 take 5ms each.
+  double seconds = time_reads(41, 0);
+  EXPECT_GE(seconds, 0.19);
+  EXPECT_LT(seconds, 2);
+}
+
+TEST_F(ThrottleTest, ReadRate) {
+  Throttle::set_limits({1 << 20, 0});
+  double seconds = time_reads(3, 256 * (1 << 10));
+  EXPECT_GE(seconds, 0.49);
+  EXPECT_LT(seconds, 2);
+}
+
+TEST_F(ThrottleTest, ParseLimits) {
+  std::istringstream in{"# Slow down.\n\nmax-read-rate=1048576\n"};
+  Throttle::Limits limits = Throttle::parse_limits(in, {0, 100});
+  EXPECT_EQ(limits, (Throttle::Limits{1048576, 100}));
+
+  std::istringstream unknown{"max-rate=10\n"};
+  EXPECT_THROW(Throttle::parse_limits(unknown, {}), std::runtime_error);
+  std::istringstream bad{"max-iops=10k\n"};
+  EXPECT_THROW(Throttle::parse_limits(bad, {}), std::runtime_error);
+}
+
+TEST_F(ThrottleTest, ControlFile) {
+  fs::path path = fs::temp_directory_path() / "undupes_throttle_test";
+  std::ofstream{path} << "max-iops=50\n";
+  Throttle::watch(path.string());
+  EXPECT_EQ(Throttle::limits(), (Throttle::Limits{0, 50}));
+
+  std::ofstream{path} << "max-iops=0\nmax-read-rate=4096\n";
+  raise(SIGHUP);
+  Throttle::account(0);
+  EXPECT_EQ(Throttle::limits(), (Throttle::Limits{4096, 0}));
+
+  // A broken file leaves the limits as they are.
+  std::ofstream{path} << "max-iops=fast\n";
+  raise(SIGHUP);
+  Throttle::account(0);
+  EXPECT_EQ(Throttle::limits(), (Throttle::Limits{4096, 0}));
+  fs::remove(path);
+}
+
+TEST_F(ThrottleTest, ReloadWhileWaiting) {
+  fs::path path = fs::temp_directory_path() / "undupes_throttle_wait_test";
+  std::ofstream{path} << "max-read-rate=1\n";
+  Throttle::watch(path.string());
+  // A year's worth of bytes, the next read waits for them.
+  Throttle::account(size_t{1} << 25);
+  auto waiting = std::async(std::launch::async, []() { Throttle::account(0); });
+  EXPECT_EQ(waiting.wait_for(std::chrono::milliseconds(200)),
+            std::future_status::timeout);
+
+  std::ofstream{path} << "max-read-rate=0\n";
+  raise(SIGHUP);
+  EXPECT_EQ(waiting.wait_for(std::chrono::seconds(2)),
+            std::future_status::ready);
+  Throttle::set_limits({});
+  fs::remove(path);
+}
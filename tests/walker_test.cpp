@@ -0,0 +1,131 @@
+/*
+Undupes: Find duplicate files.
+Copyright (C) 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// SPDX-License-Identifier: AGPL-3.0
+// SPDX-FileCopyrightText: 2024 Mmanu Chaturvedi <mmanu.chaturvedi@gmail.com>
+#include "walker.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class WalkerTest : public testing::Test {
+protected:
+  // Remember that SetUp() is run immediately before a test starts.
+  void SetUp() override {
+    fs::remove_all(dir);
+    fs::create_directories(dir / "b" / "c");
+    fs::create_directories(dir / "a");
+    write(dir / "z", 10);
+    write(dir / "a" / "x", 0);
+    write(dir / "b" / "y", 100);
+    write(dir / "b" / "c" / "w", 1000);
+    fs::create_symlink("b/y", dir / "link");
+    fs::create_directory_symlink("b", dir / "dir_link");
+  }
+
+  // TearDown() is invoked immediately after a test finishes.
+  void TearDown() override { fs::remove_all(dir); }
+
+  static void write(const fs::path &path, size_t size) {
+    std::ofstream out{path};
+    out << std::string(size, 'x');
+  }
+
+  std::vector<std::string> walk(const WalkOptions &options,
+                                ThreadPool *pool = nullptr) {
+    FileTable table;
+    IndexGroups groups;
+    Walker::walk({dir.string()}, options, table, groups, pool);
+    std::vector<std::string> paths;
+    for (FileTable::Index i : groups[0])
+      paths.push_back(table.path(i).substr(dir.string().size() + 1));
+    return paths;
+  }
+
+  fs::path dir = fs::temp_directory_path() / "undupes_walker_test";
+};
+
+TEST_F(WalkerTest, Order) {
+  std::vector<std::string> expected = {"z", "a/x", "b/y", "b/c/w"};
+  EXPECT_EQ(walk(WalkOptions{}), expected);
+  ThreadPool pool{4};
+  EXPECT_EQ(walk(WalkOptions{}, &pool), expected);
+}
+
+TEST_F(WalkerTest, Predicates) {
+  WalkOptions options;
+  options.accepted = {FileType::regular_file, FileType::symlinked_file};
+  EXPECT_EQ(walk(options),
+            (std::vector<std::string>{"link", "z", "a/x", "b/y", "b/c/w"}));
+
+  options.accepted = {FileType::symlinked_file};
+  EXPECT_EQ(walk(options), (std::vector<std::string>{"link"}));
+
+  options = WalkOptions{};
+  options.min_size = 10;
+  options.max_size = 100;
+  EXPECT_EQ(walk(options), (std::vector<std::string>{"z", "b/y"}));
+
+  options = WalkOptions{};
+  options.same_filesystem = true;
+  EXPECT_EQ(walk(options).size(), 4);
+}
+
+TEST_F(WalkerTest, Metadata) {
+  FileTable table;
+  IndexGroups groups;
+  Walker::walk({(dir / "b").string() + "/"}, WalkOptions{}, table, groups);
+  ASSERT_EQ(table.size(), 2);
+  EXPECT_EQ(table.path(0), (dir / "b" / "y").string());
+  EXPECT_EQ(table.file_size(0), 100);
+  EXPECT_EQ(table.ino(1),
+            File{(dir / "b" / "c" / "w").string()}.get_stat()->ino);
+}
+
+TEST_F(WalkerTest, DeepTreeOrder) {
+  // Directories finish in any order on the pool, their files still go into
+  // the table depth first in name order.
+  fs::remove_all(dir);
+  std::vector<std::string> expected;
+  for (int i = 0; i < 8; ++i) {
+    std::string outer = "d" + std::to_string(i);
+    for (int k = 0; k < 3; ++k) {
+      fs::create_directories(dir / outer);
+      write(dir / outer / ("f" + std::to_string(k)), 1);
+      expected.push_back(outer + "/f" + std::to_string(k));
+    }
+    for (int j = 0; j < 8; ++j) {
+      std::string inner = outer + "/e" + std::to_string(j);
+      fs::create_directories(dir / inner / "empty");
+      for (int k = 0; k < 3; ++k) {
+        write(dir / inner / ("f" + std::to_string(k)), 1);
+        expected.push_back(inner + "/f" + std::to_string(k));
+      }
+    }
+  }
+  EXPECT_EQ(walk(WalkOptions{}), expected);
+  ThreadPool pool{4};
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(walk(WalkOptions{}, &pool), expected);
+}